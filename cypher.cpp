@@ -1,7 +1,9 @@
 // fst.cpp : Ce fichier contient la fonction 'main'. L'exécution du programme commence et se termine à cet endroit.
 //
 
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <vector>
 #include <fstream>
 #include <string>
@@ -10,6 +12,7 @@
 using namespace std;
 
 #include "floodsquare.h"
+#include "floodsquareperf.h"
 
 bool read_binary_file(const std::string filename, uint8_t** idata, uint32_t *isize)
 {
@@ -17,7 +20,7 @@ bool read_binary_file(const std::string filename, uint8_t** idata, uint32_t *isi
     std::ifstream file(filename, std::ios::binary);
 
     if (!file.good())
-        throw exception("File not found");
+        throw runtime_error("File not found");
 
     file.unsetf(std::ios::skipws);
 
@@ -55,7 +58,19 @@ bool write_binary_file(const std::string filename, unsigned char* pucData, uint3
     return false;
 }
 
-void floodsquare_encrypt(std::string fnIn, std::string fnOut, std::string sKey)
+void floodsquare_report(const char *pszTitle, CFloodSquare &floodsquare, CFloodSquarePerf *pPerf)
+{
+    if (!pPerf)
+        return;
+
+    uint64_t ullPixels = (uint64_t)floodsquare._ulSquareEdge * floodsquare._ulSquareEdge;
+
+    cout << pszTitle << " : square " << floodsquare._ulSquareEdge << "x" << floodsquare._ulSquareEdge << ", counters per pixel and per call" << endl;
+    pPerf->Report(cout, ullPixels);
+    pPerf->Reset();
+}
+
+void floodsquare_encrypt(std::string fnIn, std::string fnOut, std::string sKey, CFloodSquare::ECompress eCompress = CFloodSquare::evCompressNone, CFloodSquarePerf *pPerf = 0)
 {
     CFloodSquare floodsquare;
     uint8_t *edata, *idata;
@@ -63,12 +78,15 @@ void floodsquare_encrypt(std::string fnIn, std::string fnOut, std::string sKey)
 
     read_binary_file(fnIn, &idata, &isize);
 
-    floodsquare.Encrypt(idata, isize, sKey, &edata, &esize, CFloodSquare::evSaltNone);
+    floodsquare._pObserver = pPerf;
+    floodsquare.Encrypt(idata, isize, sKey, &edata, &esize, CFloodSquare::evSaltNone, false, eCompress);
    
     write_binary_file(fnOut, edata, esize);
+
+    floodsquare_report("encrypt", floodsquare, pPerf);
 }
 
-void floodsquare_decrypt(std::string fnIn, std::string fnOut, std::string sKey)
+void floodsquare_decrypt(std::string fnIn, std::string fnOut, std::string sKey, CFloodSquarePerf *pPerf = 0)
 {
     CFloodSquare floodsquare;
     uint8_t *ddata, *idata;
@@ -76,19 +94,41 @@ void floodsquare_decrypt(std::string fnIn, std::string fnOut, std::string sKey)
 
     read_binary_file(fnIn, &idata, &isize);
 
-    floodsquare.Decrypt(idata, isize, sKey, &ddata, &dsize, CFloodSquare::evSaltNone);
+    floodsquare._pObserver = pPerf;
 
-    if(dsize > isize)
-        throw exception("Decrypion error");
+    if(!floodsquare.Decrypt(idata, isize, sKey, &ddata, &dsize, CFloodSquare::evSaltNone))
+        throw runtime_error("Decrypion error");
 
     write_binary_file(fnOut, ddata, dsize);
+
+    floodsquare_report("decrypt", floodsquare, pPerf);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    // --perf : report the hardware counters (or only the time) of the ingest, rounds and egress phases
+    // --lz   : compress the data before the transforms (older builds can't decrypt the result)
+    CFloodSquarePerf perf;
+    CFloodSquarePerf *pPerf = 0;
+    CFloodSquare::ECompress eCompress = CFloodSquare::evCompressNone;
+
+    for (int n = 1; n < argc; n++) {
+        if (0 == strcmp(argv[n], "--perf")) {
+            perf.Open();
+            pPerf = &perf;
+        }
+        else if (0 == strcmp(argv[n], "--lz")) {
+            eCompress = CFloodSquare::evCompressLZ;
+        }
+        else {
+            cerr << "Usage: " << argv[0] << " [--lz] [--perf]" << endl;
+            return 1;
+        }
+    }
+
     try {
-        floodsquare_encrypt("./Lorem_ipsum.pdf", "./Lorem_ipsum_encrypted.bin", "e1f020c91178264867f3cb99f422cb3708db08a1736aa681558a5151ba2554bb");
-        floodsquare_decrypt("./Lorem_ipsum_encrypted.bin", "./Lorem_ipsum_decrypted.pdf", "e1f020c91178264867f3cb99f422cb3708db08a1736aa681558a5151ba2554bb");
+        floodsquare_encrypt("./Lorem_ipsum.pdf", "./Lorem_ipsum_encrypted.bin", "e1f020c91178264867f3cb99f422cb3708db08a1736aa681558a5151ba2554bb", eCompress, pPerf);
+        floodsquare_decrypt("./Lorem_ipsum_encrypted.bin", "./Lorem_ipsum_decrypted.pdf", "e1f020c91178264867f3cb99f422cb3708db08a1736aa681558a5151ba2554bb", pPerf);
     }
     catch (const exception& e) {
         cerr << e.what() << endl;
@@ -20,9 +20,12 @@
 */
 
 #include <stdio.h> 
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 
 using namespace std ;
 
@@ -52,6 +55,11 @@ CFloodSquare::CFloodSquare(void) :
 	_ulBitCount(0),
 	_ulOrgDataSize(0),
 	_ulSquareEdge(0),
+	_ulGuardStride(0),
+	_ulMemorySize(0),
+	_ulSquareCapacity(0),
+	_ulMemoryCapacity(0),
+	_pObserver(0),
 	_sHexTable("0123456789ABCDEF") // Init the hexadecimal characters table
 	
 
@@ -69,29 +77,41 @@ CFloodSquare::CFloodSquare(void) :
 CFloodSquare::~CFloodSquare(void)
 {
 	Destroy() ;
+
+	std::fill(_vDecompressed.begin(), _vDecompressed.end(), 0xff) ;
 }
 
+/*! \fn        void CFloodSquare::Destroy(void)
+ *
+ *  \brief     Wipe and delete allocated arrays of bytes
+ *
+ *  \exception none
+ *  \return    none
+ */
 void CFloodSquare::Destroy(void)
 {
 	if(	_pucData ) {
-		memset(_pucData, 0xff, _ulSquareSize) ;
-		delete _pucData ;
+		memset(_pucData, 0xff, _ulSquareCapacity) ;
+		delete [] _pucData ;
 	}
 
 	if(	_pucTransform ) {
-		memset(_pucTransform, 0xff, _ulSquareSize) ;
-		delete _pucTransform ;
+		memset(_pucTransform, 0xff, _ulSquareCapacity) ;
+		delete [] _pucTransform ;
 	}
 
 	if(	_pucMemory ) {
-		memset(_pucMemory, 0xff, _ulSquareSize) ;
-		delete _pucMemory ;
+		memset(_pucMemory, 0xff, _ulMemoryCapacity) ;
+		delete [] _pucMemory ;
 	}
 
 	_pucData = 0 ;
 	_pucTransform = 0 ;
 	_pucMemory = 0 ;
+	_ulSquareCapacity = 0 ;
+	_ulMemoryCapacity = 0 ;
 	_ulSquareSize = 0 ;
+	_ulMemorySize = 0 ;
 	_ulDataSize = 0 ;
 }
 
@@ -127,27 +147,33 @@ void CFloodSquare::CardinalTransform(int nDirection, CFloodSquare::ETransform eT
 }
 
 
-/*! \fn		   Encrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uint8_t **pEncrypted, uint32_t *uEncryptedSize, ESalt eSalt)
+/*! \fn		   Encrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uint8_t **pEncrypted, uint32_t *uEncryptedSize, ESalt eSalt, bool bDump, ECompress eCompress)
 *
-*  \brief     Encrypt the data using the key passed in argument
+*  \brief     Encrypt the data using the key passed in argument. With evCompressLZ the data is first
+*             compressed, which shrinks the square and so the cost of every transform. The size stored
+*             at offset 0 then carries the FLOODSQUARE_COMPRESSED flag and the data is not salted
+*             (see Salt()). When the data doesn't compress, it is stored as without compression.
 *
 *  \param	   std::string sKey - The key
+*  \param	   ECompress eCompress - evCompressLZ to compress the data before the transforms
 *  \exception none
 *  \return    true if success or false if the key is not composed by hex characters '0123456789ABCDEF'
 */
-bool CFloodSquare::Encrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uint8_t **pEncrypted, uint32_t *uEncryptedSize, ESalt eSalt, bool bDump)
+bool CFloodSquare::Encrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uint8_t **pEncrypted, uint32_t *uEncryptedSize, ESalt eSalt, bool bDump, ECompress eCompress)
 {
-	if(evSaltNone != eSalt)
-		Salt(pData, uSize, eSalt);
+	// Check the key before Ingest(), which salts pData in place : a bad key leaves the caller's data untouched
+	for (size_t n = 0; n < sKey.length(); n++) {
+		if (_sHexTable.find(toupper(sKey[n])) == string::npos)
+			throw runtime_error("Key is not composed by hex characters '0123456789ABCDEF'");
+	}
 
-	_ulOrgDataSize = uSize;
-	// Allocate the data space composed by an unsigned long (to store the file size) followed by the file data
-	_pucOrgData = Create(_ulOrgDataSize + sizeof(uint32_t));
+	if (_pObserver)
+		_pObserver->Begin(CFloodSquareObserver::evIngest);
 
-	// Copy the size of the file in the data storage at offset 0
-	(*(uint32_t*)_pucData) = _ulOrgDataSize;
+	Ingest(pData, uSize, eSalt, eCompress);
 
-	memcpy(_pucOrgData + sizeof(uint32_t), pData, _ulOrgDataSize);
+	if (_pObserver)
+		_pObserver->End(CFloodSquareObserver::evIngest);
 
 	int nA, nB;
 
@@ -156,7 +182,7 @@ bool CFloodSquare::Encrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uin
 		string::size_type pos = _sHexTable.find(toupper(sKey[n]));
 
 		if (pos == string::npos)
-			throw exception("Key is not composed by hex characters '0123456789ABCDEF'");
+			throw runtime_error("Key is not composed by hex characters '0123456789ABCDEF'");
 
 		// Each hex digit contain 4 bits and is sliced into 2 values of 2 bits.
 		nA = (pos & 0x03);
@@ -168,11 +194,12 @@ bool CFloodSquare::Encrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uin
 
 		if (bDump) {
 			char numstr[32]; // enough to hold
-			sprintf_s(numstr, "encrypt_%04d.pbm", _bitmapNum++);
+			snprintf(numstr, sizeof(numstr), "encrypt_%04d.pbm", _bitmapNum++);
 			WritePortableBitmap(numstr);
 		}		
 	}
 
+	// No egress phase : the square is handed over in place, there is nothing to measure
 	*pEncrypted = _pucOrgData;
 	*uEncryptedSize = _ulSquareSize ;
 
@@ -180,16 +207,222 @@ bool CFloodSquare::Encrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uin
 }
 
 
+/*! \fn		   void CFloodSquare::Ingest(uint8_t *pData, uint32_t uSize, ESalt eSalt, ECompress eCompress)
+*
+*  \brief     First stage of Encrypt() : compress or salt the data, create the square and store the 
+*             size followed by the data.
+*
+*  \exception std::bad_alloc() - if memory allocation fails. 
+*  \return    none
+*/
+void CFloodSquare::Ingest(uint8_t *pData, uint32_t uSize, ESalt eSalt, ECompress eCompress)
+{
+	uint32_t ulHeader = uSize;
+	uint32_t ulCompressedSize = 0;
+
+	if (evCompressLZ == eCompress) {
+		// The compressed data must be smaller than the data, otherwise it is stored as is
+		_vCompressed.resize(uSize);
+		ulCompressedSize = Compress(pData, uSize, _vCompressed.data(), uSize);
+	}
+
+	if (ulCompressedSize) {
+		pData = _vCompressed.data();
+		uSize = ulCompressedSize;
+		ulHeader = ulCompressedSize | FLOODSQUARE_COMPRESSED;
+	}
+	else if(evSaltNone != eSalt) {
+		Salt(pData, uSize, eSalt);
+	}
+
+	_ulOrgDataSize = uSize;
+	// Allocate the data space composed by an unsigned long (to store the file size) followed by the file data
+	_pucOrgData = Create(_ulOrgDataSize + sizeof(uint32_t));
+
+	// Copy the size of the file in the data storage at offset 0
+	(*(uint32_t*)_pucData) = ulHeader;
+
+	memcpy(_pucOrgData + sizeof(uint32_t), pData, _ulOrgDataSize);
+
+	if (ulCompressedSize)
+		std::fill(_vCompressed.begin(), _vCompressed.end(), 0xff);
+}
+
+/*! \fn		   EncryptMultiKey(uint8_t *pData, uint32_t uSize, const std::vector<std::string> &vKeys, std::vector< std::vector<uint8_t> > &vEncrypted, ESalt eSalt, ECompress eCompress, size_t ulSnapshotBudget)
+*
+*  \brief     Encrypt the same data under several keys, vEncrypted[n] receiving the result of vKeys[n]
+*             (the same as Encrypt() with vKeys[n]).
+*             The transforms are applied from left to right over the key digits, so keys sharing a prefix
+*             share the intermediate squares up to the end of this prefix. The keys are sorted, which 
+*             walks their prefix trie depth first. While a key is walked, the square is saved at every
+*             depth where one of the following keys branches off : the running minimum of the longest
+*             common prefixes (LCP) of the consecutive keys from this one on. Each key then restarts from
+*             the square of its own branch point, so every shared prefix is computed once and the work
+*             is the number of trie edges.
+*             The saved squares are limited to ulSnapshotBudget bytes, over it a key restarts from a 
+*             shallower square and replays the missing digits.
+*
+*  \param	   std::vector<std::string> vKeys - The keys
+*  \param	   size_t ulSnapshotBudget - Memory allowed for the saved squares, in bytes
+*  \exception runtime_error - if a key is not composed by hex characters '0123456789ABCDEF'
+*  \return    true if success
+*/
+bool CFloodSquare::EncryptMultiKey(uint8_t *pData, uint32_t uSize, const std::vector<std::string> &vKeys, std::vector< std::vector<uint8_t> > &vEncrypted, ESalt eSalt, ECompress eCompress, size_t ulSnapshotBudget)
+{
+	struct SSnapshot {
+		size_t nDepth;					// number of key digits applied
+		std::vector<uint8_t> vSquare;
+	};
+
+	std::vector< std::vector<uint8_t> > vDigits(vKeys.size());
+	std::vector<size_t> vOrder(vKeys.size());
+
+	// Check the keys before any work, case doesn't matter
+	for (size_t k = 0; k < vKeys.size(); k++) {
+
+		for (size_t n = 0; n < vKeys[k].length(); n++) {
+
+			string::size_type pos = _sHexTable.find(toupper(vKeys[k][n]));
+
+			if (pos == string::npos)
+				throw runtime_error("Key is not composed by hex characters '0123456789ABCDEF'");
+
+			vDigits[k].push_back((uint8_t)pos);
+		}
+
+		vOrder[k] = k;
+	}
+
+	std::sort(vOrder.begin(), vOrder.end(), [&vDigits](size_t a, size_t b) { return vDigits[a] < vDigits[b]; });
+
+	// vLcp[k] : common prefix of the sorted keys k and k + 1
+	// vNextBranch[k] : first j > k with vLcp[j] < vLcp[k], the next shallower branch point on the path of key k
+	size_t nLcp = vOrder.size() ? vOrder.size() - 1 : 0;
+	std::vector<size_t> vLcp(nLcp);
+	std::vector<size_t> vNextBranch(nLcp, nLcp);
+	std::vector<size_t> vStack;
+
+	for (size_t k = 0; k < nLcp; k++) {
+		const std::vector<uint8_t> &vKey = vDigits[vOrder[k]];
+		const std::vector<uint8_t> &vNext = vDigits[vOrder[k + 1]];
+		vLcp[k] = std::mismatch(vKey.begin(), vKey.begin() + std::min(vKey.size(), vNext.size()), vNext.begin()).first - vKey.begin();
+	}
+
+	for (size_t k = nLcp; k-- > 0; ) {
+		while (!vStack.empty() && vLcp[vStack.back()] >= vLcp[k])
+			vStack.pop_back();
+		if (!vStack.empty())
+			vNextBranch[k] = vStack.back();
+		vStack.push_back(k);
+	}
+
+	// A trie edge is a key digit that isn't part of the prefix shared with the previous key
+	size_t nTrieEdges = 0;
+	size_t nApplied = 0;
+	bool bBudgetFull = false;
+
+	vEncrypted.assign(vKeys.size(), std::vector<uint8_t>());
+
+	if (_pObserver)
+		_pObserver->Begin(CFloodSquareObserver::evIngest);
+
+	Ingest(pData, uSize, eSalt, eCompress);
+
+	if (_pObserver)
+		_pObserver->End(CFloodSquareObserver::evIngest);
+
+	// The square without any transform is always kept, it is not part of the budget
+	std::vector<SSnapshot> vSnapshots(1);
+	vSnapshots[0].nDepth = 0;
+	vSnapshots[0].vSquare.assign(_pucData, _pucData + _ulSquareSize);
+
+	size_t ulUsed = 0;
+	size_t nDepth = 0;
+
+	for (size_t k = 0; k < vOrder.size(); k++) {
+
+		const std::vector<uint8_t> &vKey = vDigits[vOrder[k]];
+
+		// The current square follows the previous key : go back to the branch point with this one
+		if (k > 0) {
+
+			const std::vector<uint8_t> &vPrevious = vDigits[vOrder[k - 1]];
+			size_t nCommon = std::mismatch(vPrevious.begin(), vPrevious.begin() + std::min(vPrevious.size(), vKey.size()), vKey.begin()).first - vPrevious.begin();
+
+			if (nDepth > nCommon) {
+
+				while (vSnapshots.back().nDepth > nCommon) {
+					ulUsed -= vSnapshots.back().vSquare.size();
+					vSnapshots.pop_back();
+				}
+
+				memcpy(_pucData, vSnapshots.back().vSquare.data(), _ulSquareSize);
+				nDepth = vSnapshots.back().nDepth;
+			}
+		}
+
+		nTrieEdges += vKey.size() - (k > 0 ? vLcp[k - 1] : 0);
+
+		// Branch points of the following keys on the path of this one, the deepest first
+		std::vector<bool> vSave(vKey.size() + 1, false);
+
+		for (size_t j = k; j < nLcp; j = vNextBranch[j])
+			vSave[vLcp[j]] = true;
+
+		for ( ; nDepth < vKey.size(); nDepth++) {
+
+			if (vSave[nDepth] && nDepth > vSnapshots.back().nDepth) {
+
+				if (ulUsed + _ulSquareSize <= ulSnapshotBudget) {
+					vSnapshots.push_back(SSnapshot());
+					vSnapshots.back().nDepth = nDepth;
+					vSnapshots.back().vSquare.assign(_pucData, _pucData + _ulSquareSize);
+					ulUsed += _ulSquareSize;
+				}
+				else {
+					bBudgetFull = true;
+				}
+			}
+
+			// Same transforms as Encrypt()
+			CardinalTransform(vKey[nDepth] & 0x03, CFloodSquare::evRegular);
+			CardinalTransform((vKey[nDepth] & 0x0C) >> 2, CFloodSquare::evRegular);
+			nApplied++;
+		}
+
+		if (_pObserver)
+			_pObserver->Begin(CFloodSquareObserver::evEgress);
+
+		vEncrypted[vOrder[k]].assign(_pucData, _pucData + _ulSquareSize);
+
+		if (_pObserver)
+			_pObserver->End(CFloodSquareObserver::evEgress);
+	}
+
+	// Within the budget, every trie edge is applied exactly once
+	assert(bBudgetFull || nApplied == nTrieEdges);
+
+	for (size_t n = 0; n < vSnapshots.size(); n++)
+		std::fill(vSnapshots[n].vSquare.begin(), vSnapshots[n].vSquare.end(), 0xff);
+
+	return true;
+}
+
 /*! \fn		   Decrypt(uint8_t* pData, uint32_t uSize, std::string sKey, uint8_t** pDecrypted, uint32_t* uDecryptedSize, ESalt eSalt)
 *
-*  \brief     Decrypt the data using the key passed in argument
+*  \brief     Decrypt the data using the key passed in argument. A payload flagged FLOODSQUARE_COMPRESSED
+*             is decompressed, *pDecrypted then points to _vDecompressed.
 *
 *  \param	   std::string sKey - The key
 *  \exception none
 *  \return    true if success or false if the key is not composed by hexa characters '0123456789ABCDEF'
+*             or if the decrypted size or the compressed payload are inconsistent (wrong key).
 */
 bool CFloodSquare::Decrypt(uint8_t* pData, uint32_t uSize, std::string sKey, uint8_t** pDecrypted, uint32_t* uDecryptedSize, ESalt eSalt, bool bDump)
 {
+	if (_pObserver)
+		_pObserver->Begin(CFloodSquareObserver::evIngest);
+
 	// Get input file size
 	_ulOrgDataSize = uSize;
 	// Allocate the data space
@@ -197,6 +430,9 @@ bool CFloodSquare::Decrypt(uint8_t* pData, uint32_t uSize, std::string sKey, uin
 
 	memcpy(_pucTransform, pData, _ulSquareSize);
 
+	if (_pObserver)
+		_pObserver->End(CFloodSquareObserver::evIngest);
+
 	int nA, nB;
 
 	// For decryption, we read the key string in reverse order
@@ -205,7 +441,7 @@ bool CFloodSquare::Decrypt(uint8_t* pData, uint32_t uSize, std::string sKey, uin
 		string::size_type pos = _sHexTable.find(toupper(sKey[n]));
 
 		if (pos == string::npos)
-			throw exception("Key is not composed by hex characters '0123456789ABCDEF'");
+			throw runtime_error("Key is not composed by hex characters '0123456789ABCDEF'");
 
 		// Each hex digit contain 4 bits and is sliced into 2 values of 2 bits.
 		nA = (pos & 0x03);
@@ -217,12 +453,50 @@ bool CFloodSquare::Decrypt(uint8_t* pData, uint32_t uSize, std::string sKey, uin
 
 		if (bDump) {
 			char numstr[32]; // enough to hold
-			sprintf_s(numstr, "decrypt_%04d.pbm", _bitmapNum++);
+			snprintf(numstr, sizeof(numstr), "decrypt_%04d.pbm", _bitmapNum++);
 			WritePortableBitmap(numstr);
 		}
 	}
 
+	if (_pObserver)
+		_pObserver->Begin(CFloodSquareObserver::evEgress);
+
+	bool bResult = Egress(pDecrypted, uDecryptedSize, eSalt);
+
+	if (_pObserver)
+		_pObserver->End(CFloodSquareObserver::evEgress);
+
+	return bResult;
+}
+
+/*! \fn		   bool CFloodSquare::Egress(uint8_t **pDecrypted, uint32_t *uDecryptedSize, ESalt eSalt)
+*
+*  \brief     Last stage of Decrypt() : check the size stored at offset 0, then decompress or unsalt the data.
+*
+*  \exception std::bad_alloc() - if memory allocation fails. 
+*  \return    true if success or false if the size or the compressed payload are inconsistent.
+*/
+bool CFloodSquare::Egress(uint8_t **pDecrypted, uint32_t *uDecryptedSize, ESalt eSalt)
+{
 	uint32_t ulSize = (*(uint32_t*)_pucOrgData);
+	bool bCompressed = (ulSize & FLOODSQUARE_COMPRESSED) != 0;
+
+	ulSize &= ~FLOODSQUARE_COMPRESSED;
+
+	if (_ulSquareSize < sizeof(uint32_t) || ulSize > _ulSquareSize - sizeof(uint32_t))
+		return false;
+
+	if (bCompressed) {
+
+		if (!Decompress(_pucOrgData + sizeof(uint32_t), ulSize, _vDecompressed))
+			return false;
+
+		*uDecryptedSize = (uint32_t)_vDecompressed.size();
+		*pDecrypted = _vDecompressed.data();
+
+		return true;
+	}
+
 	*uDecryptedSize = ulSize;
 	*pDecrypted = _pucOrgData + sizeof(uint32_t);
 
@@ -283,6 +557,227 @@ void CFloodSquare::Salt(uint8_t* pData, uint32_t uSize, ESalt eSalt)
 	}
 }
 
+// LZ parameters, see Compress()
+#define LZ_MIN_MATCH	4
+#define LZ_MAX_OFFSET	0xFFFF
+#define LZ_HASH_BITS	12
+
+/*! \fn		   uint32_t CFloodSquare::Compress(const uint8_t *pData, uint32_t uSize, uint8_t *pCompressed, uint32_t uCapacity)
+ *
+ *  \brief     Fast LZ77 compression (LZ4 like block format), used before the transforms.
+ *             The output starts with the data size (32 bits), followed by sequences made of :
+ *               - a token : literal count in the high nibble, match length - 4 in the low nibble,
+ *                 a nibble of 15 is continued by bytes added to it until a byte lower than 255,
+ *               - the literals,
+ *               - the match offset (16 bits, little endian), absent in the last sequence.
+ *             Matches are found with a hash table of the last position of each 4 bytes sequence.
+ *
+ *  \param	   pData - The data to compress
+ *  \param	   uSize - The size of the data
+ *  \param	   pCompressed - The output area
+ *  \param	   uCapacity - The size of the output area
+ *  \exception none
+ *  \return    The compressed size, or 0 if it doesn't fit in uCapacity bytes.
+ */
+uint32_t CFloodSquare::Compress(const uint8_t *pData, uint32_t uSize, uint8_t *pCompressed, uint32_t uCapacity)
+{
+	uint32_t aulHash[1 << LZ_HASH_BITS] ;
+	uint32_t ulIn = 0 ;
+	uint32_t ulAnchor = 0 ;
+	uint32_t ulOut = sizeof(uint32_t) ;
+
+	if(uCapacity < sizeof(uint32_t))
+		return 0 ;
+
+	memcpy(pCompressed, &uSize, sizeof(uint32_t)) ;
+	memset(aulHash, 0, sizeof(aulHash)) ;
+
+	for(;;) {
+
+		uint32_t ulMatch = 0 ;
+		uint32_t ulOffset = 0 ;
+
+		// Look for a match at each position until one is found or the end of the data
+		while(ulIn + LZ_MIN_MATCH <= uSize) {
+
+			uint32_t ulSequence ;
+			memcpy(&ulSequence, pData + ulIn, sizeof(uint32_t)) ;
+
+			uint32_t ulHash = (ulSequence * 2654435761U) >> (32 - LZ_HASH_BITS) ;
+			uint32_t ulRef = aulHash[ulHash] ;
+
+			aulHash[ulHash] = ulIn ;
+
+			if(ulRef < ulIn && ulIn - ulRef <= LZ_MAX_OFFSET && 0 == memcmp(pData + ulRef, pData + ulIn, LZ_MIN_MATCH)) {
+
+				ulMatch = LZ_MIN_MATCH ;
+
+				while(ulIn + ulMatch < uSize && pData[ulRef + ulMatch] == pData[ulIn + ulMatch])
+					ulMatch++ ;
+
+				ulOffset = ulIn - ulRef ;
+				break ;
+			}
+
+			ulIn++ ;
+		}
+
+		// Without match, the remaining data goes into the last sequence
+		if(0 == ulMatch)
+			ulIn = uSize ;
+
+		uint32_t ulLiterals = ulIn - ulAnchor ;
+		uint32_t ulLength = ulMatch ? ulMatch - LZ_MIN_MATCH : 0 ;
+
+		// Worst case size of the sequence : token, length bytes, literals and offset
+		if((uint64_t)ulOut + 1 + (ulLiterals / 255 + 1) + (ulLength / 255 + 1) + ulLiterals + 2 > uCapacity)
+			return 0 ;
+
+		pCompressed[ulOut++] = (uint8_t)(((ulLiterals < 15 ? ulLiterals : 15) << 4) | (ulLength < 15 ? ulLength : 15)) ;
+
+		if(ulLiterals >= 15) {
+			uint32_t n = ulLiterals - 15 ;
+			for( ; n >= 255 ; n -= 255)
+				pCompressed[ulOut++] = 255 ;
+			pCompressed[ulOut++] = (uint8_t)n ;
+		}
+
+		memcpy(pCompressed + ulOut, pData + ulAnchor, ulLiterals) ;
+		ulOut += ulLiterals ;
+
+		if(0 == ulMatch)
+			break ;
+
+		pCompressed[ulOut++] = (uint8_t)(ulOffset & 0xff) ;
+		pCompressed[ulOut++] = (uint8_t)(ulOffset >> 8) ;
+
+		if(ulLength >= 15) {
+			uint32_t n = ulLength - 15 ;
+			for( ; n >= 255 ; n -= 255)
+				pCompressed[ulOut++] = 255 ;
+			pCompressed[ulOut++] = (uint8_t)n ;
+		}
+
+		ulIn += ulMatch ;
+		ulAnchor = ulIn ;
+	}
+
+	return ulOut < uCapacity ? ulOut : 0 ;
+}
+
+/*! \fn		   static void Grow(std::vector<uint8_t> &vData, uint32_t ulNeeded, uint32_t ulMaxSize)
+ *
+ *  \brief     Make vData hold at least ulNeeded bytes, doubling its size but never beyond ulMaxSize.
+ *
+ *  \exception std::bad_alloc() - if memory allocation fails.
+ *  \return    none
+ */
+static void Grow(std::vector<uint8_t> &vData, uint32_t ulNeeded, uint32_t ulMaxSize)
+{
+	if(ulNeeded <= vData.size())
+		return ;
+
+	vData.resize(std::max((uint64_t)ulNeeded, std::min((uint64_t)vData.size() * 2, (uint64_t)ulMaxSize))) ;
+}
+
+/*! \fn		   bool CFloodSquare::Decompress(const uint8_t *pCompressed, uint32_t uSize, std::vector<uint8_t> &vData)
+ *
+ *  \brief     Decompress the output of Compress(). Every length and offset is checked, so a
+ *             payload decrypted with a wrong key is rejected instead of overflowing. The header
+ *             size isn't trusted for the allocation : vData grows with the bytes actually
+ *             produced, so a bogus header doesn't allocate 255 times the square up front.
+ *
+ *  \param	   pCompressed - The compressed data
+ *  \param	   uSize - The size of the compressed data
+ *  \param	   vData - The decompressed data
+ *  \exception std::bad_alloc() - if memory allocation fails.
+ *  \return    true if success, false if the compressed data is inconsistent.
+ */
+bool CFloodSquare::Decompress(const uint8_t *pCompressed, uint32_t uSize, std::vector<uint8_t> &vData)
+{
+	uint32_t ulDataSize ;
+	uint32_t ulIn = sizeof(uint32_t) ;
+	uint32_t ulOut = 0 ;
+
+	if(uSize < sizeof(uint32_t))
+		return false ;
+
+	memcpy(&ulDataSize, pCompressed, sizeof(uint32_t)) ;
+
+	// A byte of compressed data never expands to more than 255 bytes
+	if((uint64_t)ulDataSize > (uint64_t)uSize * 255)
+		return false ;
+
+	// Start from a typical ratio, Grow() doubles it (up to ulDataSize) as the output needs
+	vData.resize(std::min((uint64_t)ulDataSize, (uint64_t)uSize * 4)) ;
+
+	while(ulIn < uSize) {
+
+		uint8_t ucToken = pCompressed[ulIn++] ;
+		uint32_t ulLiterals = ucToken >> 4 ;
+		uint32_t ulMatch = ucToken & 0x0f ;
+
+		if(15 == ulLiterals) {
+			uint8_t uc ;
+			do {
+				if(ulIn >= uSize)
+					return false ;
+				uc = pCompressed[ulIn++] ;
+				ulLiterals += uc ;
+			} while(255 == uc) ;
+		}
+
+		if(ulLiterals > uSize - ulIn || ulLiterals > ulDataSize - ulOut)
+			return false ;
+
+		Grow(vData, ulOut + ulLiterals, ulDataSize) ;
+
+		memcpy(vData.data() + ulOut, pCompressed + ulIn, ulLiterals) ;
+		ulIn += ulLiterals ;
+		ulOut += ulLiterals ;
+
+		// The last sequence has no match
+		if(ulIn == uSize)
+			break ;
+
+		if(uSize - ulIn < 2)
+			return false ;
+
+		uint32_t ulOffset = pCompressed[ulIn] | (pCompressed[ulIn + 1] << 8) ;
+		ulIn += 2 ;
+
+		if(0 == ulOffset || ulOffset > ulOut)
+			return false ;
+
+		if(15 == ulMatch) {
+			uint8_t uc ;
+			do {
+				if(ulIn >= uSize)
+					return false ;
+				uc = pCompressed[ulIn++] ;
+				ulMatch += uc ;
+			} while(255 == uc) ;
+		}
+
+		ulMatch += LZ_MIN_MATCH ;
+
+		if(ulMatch > ulDataSize - ulOut)
+			return false ;
+
+		Grow(vData, ulOut + ulMatch, ulDataSize) ;
+
+		// Byte by byte, the match may overlap the bytes it produces
+		uint8_t *puc = vData.data() + ulOut ;
+		const uint8_t *pucRef = puc - ulOffset ;
+		for(uint32_t n = 0 ; n < ulMatch ; n++)
+			puc[n] = pucRef[n] ;
+
+		ulOut += ulMatch ;
+	}
+
+	return ulOut == ulDataSize ;
+}
+
 /*! \fn		   void CFloodSquare::TransposeCoordinates(uint32_t &cx, uint32_t &cy, EDirection eDirection)
  *
  *  \brief     Modify the coordinates cx and cy passed in reference according to the cardinal direction.
@@ -322,6 +817,8 @@ void CFloodSquare::TransposeCoordinates(uint32_t &cx, uint32_t &cy, EDirection e
 /*! \fn		   unsigned char *CFloodSquare::Create(uint32_t ulDataSize)
  *
  *  \brief     Create the DataSquare, compute sizes and allocate areas.
+ *             The areas of a previous square are reused when they are large enough, so an 
+ *             object that encrypts or decrypts several times keeps its buffers warm.
  *
  *  \param	   ulDataSize - The size of the data block to load into the DataSquare.
  *  \exception std::bad_alloc() - if memory allocation fails. 
@@ -330,10 +827,9 @@ void CFloodSquare::TransposeCoordinates(uint32_t &cx, uint32_t &cy, EDirection e
 unsigned char *CFloodSquare::Create(uint32_t ulDataSize) 
 {
 	_bitmapNum = 0;
-	_ulDataSize = ulDataSize ;
 
 	// Get the size in bits (pixels)
-	_ulBitCount = _ulDataSize << 3 ;		// mul 8 
+	_ulBitCount = ulDataSize << 3 ;		// mul 8 
 
 	// Compute the square edge length
 	_ulSquareEdge = IntegerSquareRoot (_ulBitCount) ;
@@ -348,29 +844,48 @@ unsigned char *CFloodSquare::Create(uint32_t ulDataSize)
 	// Get the size in bytes 
 	_ulSquareSize = (_ulSquareEdge * _ulSquareEdge) >> 3 ;	// div 8 
 
-	// Allocate source array
-	_pucData = new unsigned char [_ulSquareSize] ;
+	// The memory array is surrounded by a one pixel guard border, see MarkGuardBorder()
+	_ulGuardStride = _ulSquareEdge + 2 ;
+	_ulMemorySize = ((_ulGuardStride * _ulGuardStride) + 7) >> 3 ;
 
-	if(0 == _pucData)
-		throw std::bad_alloc() ;
-	
-	memset(_pucData, 0xff, _ulSquareSize) ;
+	if(_ulSquareSize > _ulSquareCapacity || _ulMemorySize > _ulMemoryCapacity) {
 
-	// Allocate transform array
-	_pucTransform = new unsigned char [_ulSquareSize] ;	
+		uint32_t ulSquareSize = _ulSquareSize ;
+		uint32_t ulMemorySize = _ulMemorySize ;
 
-	if(0 == _pucTransform)
-		throw std::bad_alloc() ;
+		// The previous areas are too small
+		Destroy() ;
 
-	memset(_pucTransform, 0x00, _ulSquareSize) ;
+		_ulSquareSize = ulSquareSize ;
+		_ulMemorySize = ulMemorySize ;
+
+		// Allocate source array
+		_pucData = new unsigned char [_ulSquareSize] ;
+
+		if(0 == _pucData)
+			throw std::bad_alloc() ;
+
+		// Allocate transform array
+		_pucTransform = new unsigned char [_ulSquareSize] ;	
 
-	// Allocate pixel memory array (already known pixel)
-	_pucMemory = new unsigned char [_ulSquareSize] ;
+		if(0 == _pucTransform)
+			throw std::bad_alloc() ;
+
+		// Allocate pixel memory array (already known pixel)
+		_pucMemory = new unsigned char [_ulMemorySize] ;
 	
-	if(0 == _pucMemory)
-		throw std::bad_alloc() ;
+		if(0 == _pucMemory)
+			throw std::bad_alloc() ;
+
+		_ulSquareCapacity = _ulSquareSize ;
+		_ulMemoryCapacity = _ulMemorySize ;
+	}
 
-	memset(_pucMemory, 0x00, _ulSquareSize) ;
+	_ulDataSize = ulDataSize ;
+
+	memset(_pucData, 0xff, _ulSquareSize) ;
+	memset(_pucTransform, 0x00, _ulSquareSize) ;
+	memset(_pucMemory, 0x00, _ulMemorySize) ;
 		
 	return _pucData ;
 }
@@ -391,41 +906,70 @@ void CFloodSquare::Transform(EDirection eDirection, ETransform eTransform)
 	uint32_t cx ;
 	uint32_t cy ;
 	uint32_t nTransformBitCount = 0 ;
+	uint32_t aulDataOffset[4] ;
+	uint32_t aulMemoryOffset[4] ;
+
+	if(_pObserver)
+		_pObserver->Begin(CFloodSquareObserver::evRounds) ;
 
 	if(evRegular == eTransform) {
 		memset(_pucTransform, 0x00, _ulSquareSize) ;
-		memset(_pucMemory, 0x00, _ulSquareSize) ;
 	}
 	else {
 		memset(_pucData, 0x00, _ulSquareSize) ;
-		memset(_pucMemory, 0x00, _ulSquareSize) ;
+	}
+
+	memset(_pucMemory, 0x00, _ulMemorySize) ;
+	MarkGuardBorder() ;
+
+	// Once transposed, a step around the pixel is a constant linear offset (+/-1 or +/-row length). 
+	// Compute them from the center of a 3x3 block, unsigned arithmetic wraps the negative offsets.
+	for(size_t i = 0 ; i < sizeof(aLookAround) / sizeof(SLookAround) ; i++) {
+		uint32_t ox = 1, oy = 1 ;
+		uint32_t nx = 1 + aLookAround[i].ox, ny = 1 + aLookAround[i].oy ;
+
+		TransposeCoordinates(ox, oy, eDirection) ;
+		TransposeCoordinates(nx, ny, eDirection) ;
+
+		aulDataOffset[i] = (nx + (_ulSquareEdge * ny)) - (ox + (_ulSquareEdge * oy)) ;
+		aulMemoryOffset[i] = (nx + (_ulGuardStride * ny)) - (ox + (_ulGuardStride * oy)) ;
 	}
 
 	// For each point in the square
 	for(cx = 0 ; cx < _ulSquareEdge ; cx++) {
 		
 		for(cy = 0 ; cy < _ulSquareEdge ; cy++) {
+
+			uint32_t tx = cx ;
+			uint32_t ty = cy ;
+
+			TransposeCoordinates(tx, ty, eDirection) ;
+
+			SPoint p = { (tx + 1) + (_ulGuardStride * (ty + 1)), tx + (_ulSquareEdge * ty) } ;
 						
 			// Found a black pixel : push coordinates on stack for later use
-			if( evBlack == GetPixel(cx, cy, nTransformBitCount, eTransform, eDirection) ) {
-				sp.push({ cx,cy });
+			if( evBlack == GetPixel(p.ulMemoryBit, p.ulDataBit, nTransformBitCount, eTransform) ) {
+				sp.push(p);
 			}
 			
 			// While the coordinates stack is not empty
 			while( !sp.empty() ) {
 				
 				// Pop coordinates
-				SPoint p = sp.top();
+				p = sp.top();
 				sp.pop();
 
 				// Change pixel color to white
-				LightPixel(p.x, p.y, eDirection) ;
+				LightPixel(p.ulDataBit) ;
 				
-				// Explore around the pixel and push black pixels coordinates on stack
+				// Explore around the pixel and push black pixels coordinates on stack. 
+				// Neighbours outside the square fall on the guard border, which is always known.
 				for(int i = 0 ; i < sizeof(aLookAround) / sizeof(SLookAround) ; i++) {
+
+					SPoint n = { p.ulMemoryBit + aulMemoryOffset[i], p.ulDataBit + aulDataOffset[i] } ;
 					
-					if( evBlack == GetPixel(p.x + aLookAround[i].ox, p.y + aLookAround[i].oy, nTransformBitCount, eTransform, eDirection) ) {
-						sp.push({ p.x + aLookAround[i].ox, p.y + aLookAround[i].oy });
+					if( evBlack == GetPixel(n.ulMemoryBit, n.ulDataBit, nTransformBitCount, eTransform) ) {
+						sp.push(n);
 					}
 				}
 			}
@@ -436,43 +980,62 @@ void CFloodSquare::Transform(EDirection eDirection, ETransform eTransform)
 		memcpy(_pucData, _pucTransform, _ulSquareSize) ;
 	else
 		memcpy(_pucTransform, _pucData, _ulSquareSize) ;
+
+	if(_pObserver)
+		_pObserver->End(CFloodSquareObserver::evRounds) ;
+}
+
+/*! \fn		   void CFloodSquare::MarkGuardBorder(void)
+ *
+ *  \brief     Mark the one pixel border surrounding the square in the memory area (_pucMemory) as
+ *			   already known. Neighbour probes can then step outside the square without any range check.
+ *             
+ *  \exception none 
+ *  \return    none
+ */
+void CFloodSquare::MarkGuardBorder(void)
+{
+	uint32_t n ;
+	uint32_t ulLast = _ulGuardStride - 1 ;
+
+	for(n = 0 ; n < _ulGuardStride ; n++) {
+		SetBit(_pucMemory, n) ;									// top row
+		SetBit(_pucMemory, n + (_ulGuardStride * ulLast)) ;		// bottom row
+		SetBit(_pucMemory, _ulGuardStride * n) ;				// left column
+		SetBit(_pucMemory, ulLast + (_ulGuardStride * n)) ;		// right column
+	}
 }
 
 
 
-/*! \fn		   unsigned char CFloodSquare::GetPixel(uint32_t cx, uint32_t cy, uint32_t &nTransformBitCount, ETransform eTransform, EDirection eDirection)
+/*! \fn		   unsigned char CFloodSquare::GetPixel(uint32_t ulMemoryBit, uint32_t ulDataBit, uint32_t &nTransformBitCount, ETransform eTransform)
  *
- *  \brief     Return the pixel value or an error code if coordinates are out of range.
+ *  \brief     Return the pixel value.
  *			   This method not only get a pixel value, we also fill the transform array 
  *			   of bits (_pucTranform) in regular mode or we query this array en inverse mode.
  *			   We don't query more than one time each pixel, this is the reason why we store 
  *			   in the memory area (_pucMemory) if the pixel was requested before (already known).
+ *			   The guard border of the memory area is always known, so pixels outside the square 
+ *			   are reported as evWhite and their data bit number is never used.
  *             
- *  \param	   cx - X coordinate
- *  \param	   cy - Y coordinate
- *  \param	   eDirection - Direction on where to turn coordinates.
+ *  \param	   ulMemoryBit - Bit number of the pixel in the guarded memory area
+ *  \param	   ulDataBit - Bit number of the pixel in the data area
+ *  \param	   eTransform - Type of transform, regular or invert transform.
  *  \exception none 
- *  \return    returns evWhite or evBlack or evOutOfRange if The coordinates are out of square range.
+ *  \return    returns evWhite or evBlack.
  */
-CFloodSquare::EPixel CFloodSquare::GetPixel(uint32_t cx, uint32_t cy, uint32_t &nTransformBitCount, ETransform eTransform, EDirection eDirection)
+CFloodSquare::EPixel CFloodSquare::GetPixel(uint32_t ulMemoryBit, uint32_t ulDataBit, uint32_t &nTransformBitCount, ETransform eTransform)
 {
-	TransposeCoordinates(cx, cy, eDirection) ;
-
-	// If outside the square return "evOutOfRange"
-	if( cy >= _ulSquareEdge || cx >= _ulSquareEdge) {
-		return evOutOfRange ;
-	} 
-
 	// Bit already known ?
-	if( IsSet(_pucMemory, cx + (_ulSquareEdge * cy) ) )
+	if( IsSet(_pucMemory, ulMemoryBit) )
 		return evWhite ;
 
 	// Mark the bit as known !
-	SetBit(_pucMemory, cx + (_ulSquareEdge * cy)) ;
+	SetBit(_pucMemory, ulMemoryBit) ;
 	
 	if(evRegular == eTransform) {
 
-		if( IsSet(_pucData, cx + (_ulSquareEdge * cy) ) ) {
+		if( IsSet(_pucData, ulDataBit) ) {
 			SetBit(_pucTransform, nTransformBitCount) ;
 			nTransformBitCount++ ;
 			return evBlack ;
@@ -491,21 +1054,17 @@ CFloodSquare::EPixel CFloodSquare::GetPixel(uint32_t cx, uint32_t cy, uint32_t &
 	return evWhite ;
 }
 
-/*! \fn		   void CFloodSquare::LightPixel(uint32_t cx, uint32_t cy, EDirection eDirection)
+/*! \fn		   void CFloodSquare::LightPixel(uint32_t ulDataBit)
  *
- *  \brief     Set the pixel (after having transposed the coordinates) to 'evWhite'
+ *  \brief     Set the pixel to 'evWhite'
  *             
- *  \param	   cx - X coordinate
- *  \param	   cy - Y coordinate
- *  \param	   eDirection - Direction on where to turn coordinates.
+ *  \param	   ulDataBit - Bit number of the pixel in the data area (already transposed)
  *  \exception none 
  *  \return    none
  */
-void CFloodSquare::LightPixel(uint32_t cx, uint32_t cy, EDirection eDirection)
+void CFloodSquare::LightPixel(uint32_t ulDataBit)
 {
-	TransposeCoordinates(cx, cy, eDirection) ;
-
-	SetBit(_pucData, cx + (_ulSquareEdge * cy) ) ;
+	SetBit(_pucData, ulDataBit) ;
 }
 
 /*! \fn		   int CFloodSquare::WritePortableBitmap(char *pszFilename)
@@ -1,7 +1,34 @@
 #if !defined(_FLOODSQUARE_H_INCLUDED_)
 #define _FLOODSQUARE_H_INCLUDED_
 
+#include <cstdint>
 #include <stack>
+#include <string>
+#include <vector>
+
+// Flag set in the size stored at offset 0 of the square when the payload is LZ compressed
+#define FLOODSQUARE_COMPRESSED	0x80000000
+
+/*! \class   CFloodSquareObserver
+ *
+ *  \brief   Optional hook on the phases of CFloodSquare : ingest (salt, compression and
+ *           loading of the square), rounds (one per Transform()) and egress (copy or check
+ *           of the result). Set CFloodSquare::_pObserver to receive the calls, e.g. with
+ *           CFloodSquarePerf (floodsquareperf.h). Nothing is called when it is null.
+ */
+class CFloodSquareObserver
+{
+public:
+	enum EPhase { evIngest, evRounds, evEgress, evPhaseCount } ;
+
+	virtual ~CFloodSquareObserver(void) {}
+
+	virtual void Begin(EPhase ePhase) = 0 ;
+	virtual void End(EPhase ePhase) = 0 ;
+} ;
+
+// Default memory budget of the intermediate squares kept by EncryptMultiKey(), in bytes
+#define FLOODSQUARE_SNAPSHOT_BUDGET	(64 * 1024 * 1024)
 
 /*! \class   CFloodSquare
  *
@@ -22,6 +49,7 @@ public:
 	enum EPixel     { evBlack, evWhite, evOutOfRange } ;
 	enum ESalt		{ evSaltNone = 0x0000, evSalt = 0xA53C } ;
 	enum EDirection { evNorth, evSouth, evEast, evWest } ;
+	enum ECompress  { evCompressNone, evCompressLZ } ;
 	
 	unsigned char *Create(uint32_t ulDataSize) ;
 
@@ -31,7 +59,11 @@ public:
 	void Salt(uint8_t* pData, uint32_t uSize, ESalt eSalt = evSalt) ;
 
 	bool Decrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uint8_t **ppDecrypted, uint32_t *uDecryptedSize, ESalt eSalt = evSalt, bool bDump = false);
-	bool Encrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uint8_t **ppEncrypted, uint32_t *uEncryptedSize, ESalt eSalt = evSalt, bool bDump = false);
+	bool Encrypt(uint8_t *pData, uint32_t uSize, std::string sKey, uint8_t **ppEncrypted, uint32_t *uEncryptedSize, ESalt eSalt = evSalt, bool bDump = false, ECompress eCompress = evCompressNone);
+	bool EncryptMultiKey(uint8_t *pData, uint32_t uSize, const std::vector<std::string> &vKeys, std::vector< std::vector<uint8_t> > &vEncrypted, ESalt eSalt = evSalt, ECompress eCompress = evCompressNone, size_t ulSnapshotBudget = FLOODSQUARE_SNAPSHOT_BUDGET);
+
+	uint32_t Compress(const uint8_t *pData, uint32_t uSize, uint8_t *pCompressed, uint32_t uCapacity) ;
+	bool Decompress(const uint8_t *pCompressed, uint32_t uSize, std::vector<uint8_t> &vData) ;
 
 	void Allocate(uint32_t uSize);
 
@@ -47,11 +79,22 @@ public:
 	uint32_t _ulBitCount ;	  // in bits
 	uint32_t _ulSquareEdge ; // in bits
 
+	uint32_t _ulGuardStride ; // in bits, row length of the memory array (square edge + guard border)
+	uint32_t _ulMemorySize ;  // in bytes
+
+	uint32_t _ulSquareCapacity ; // in bytes, allocated size of the data and transform arrays
+	uint32_t _ulMemoryCapacity ; // in bytes, allocated size of the memory array
+
 	uint8_t *_pucOrgData;
 	uint32_t _ulOrgDataSize;
 
 	int _bitmapNum;
 
+	std::vector<uint8_t> _vCompressed ;		// Encrypt() scratch area
+	std::vector<uint8_t> _vDecompressed ;	// Decrypt() output of a compressed payload
+
+	CFloodSquareObserver *_pObserver ;		// optional phase hook, see CFloodSquareObserver
+
 	const std::string _sHexTable;
 	
 private:
@@ -100,16 +143,21 @@ private:
 
 	uint32_t IntegerSquareRoot(uint32_t ulValue) ;
 
-	EPixel GetPixel(uint32_t cx, uint32_t cy, uint32_t &nTransformBitCount, 
-		ETransform eTransform, EDirection eDirection) ;
+	void Ingest(uint8_t *pData, uint32_t uSize, ESalt eSalt, ECompress eCompress) ;
+	bool Egress(uint8_t **ppDecrypted, uint32_t *uDecryptedSize, ESalt eSalt) ;
+
+	EPixel GetPixel(uint32_t ulMemoryBit, uint32_t ulDataBit, uint32_t &nTransformBitCount, 
+		ETransform eTransform) ;
+
+	void LightPixel(uint32_t ulDataBit) ;
 
-	void LightPixel(uint32_t cx, uint32_t cy, EDirection eDirection) ;
+	void MarkGuardBorder(void) ;
 
 	void TransposeCoordinates(uint32_t &cx, uint32_t &cy, EDirection eDirection) ;
 	
 	struct  SPoint {
-		uint32_t x;
-		uint32_t y;
+		uint32_t ulMemoryBit;	// bit number in the guarded memory array
+		uint32_t ulDataBit;		// bit number in the data array
 	};
 
 	std::stack < SPoint > sp ;	
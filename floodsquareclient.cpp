@@ -0,0 +1,278 @@
+/*
+
+  FloodSquare Cipher - floodsquareclient.cpp
+  Version 0.0.1
+
+  Client library of the floodsquared daemon (Linux only).
+
+    Simply compile :
+      g++ -c floodsquareclient.cpp
+
+*/
+
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std ;
+
+#include "floodsquareclient.h"
+
+/*! \fn		   CFloodSquareClient::CFloodSquareClient(void)
+ *
+ *  \brief	   Constructor, not connected and no shared buffer.
+ *
+ *  \exception none
+ *  \return    none
+ */
+CFloodSquareClient::CFloodSquareClient(void) :
+	_eLastStatus(evSuccess),
+	_nSocket(-1),
+	_nBuffer(-1),
+	_pucBuffer(0),
+	_ulBufferSize(0),
+	_bBufferSent(false)
+{
+}
+
+/*! \fn        CFloodSquareClient::~CFloodSquareClient(void)
+ *
+ *  \brief     Destructor, close the connection and release the shared buffer.
+ *
+ *  \exception none
+ *  \return    none
+ */
+CFloodSquareClient::~CFloodSquareClient(void)
+{
+	Close() ;
+	ReleaseBuffer() ;
+}
+
+/*! \fn		   bool CFloodSquareClient::Connect(const std::string &sPath)
+ *
+ *  \brief     Connect to the daemon listening on the Unix domain socket sPath.
+ *
+ *  \exception none
+ *  \return    true if connected
+ */
+bool CFloodSquareClient::Connect(const std::string &sPath)
+{
+	struct sockaddr_un addr ;
+
+	Close() ;
+
+	if(sPath.length() >= sizeof(addr.sun_path))
+		return false ;
+
+	memset(&addr, 0, sizeof(addr)) ;
+	addr.sun_family = AF_UNIX ;
+	memcpy(addr.sun_path, sPath.c_str(), sPath.length()) ;
+
+	_nSocket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0) ;
+
+	if(_nSocket < 0)
+		return false ;
+
+	if(connect(_nSocket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		Close() ;
+		return false ;
+	}
+
+	// The daemon maps the buffer per connection, a new connection doesn't know it yet
+	_bBufferSent = false ;
+
+	return true ;
+}
+
+/*! \fn		   void CFloodSquareClient::Close(void)
+ *
+ *  \brief     Close the connection, the shared buffer stays valid.
+ *
+ *  \exception none
+ *  \return    none
+ */
+void CFloodSquareClient::Close(void)
+{
+	if(_nSocket >= 0)
+		close(_nSocket) ;
+
+	_nSocket = -1 ;
+	_bBufferSent = false ;
+}
+
+/*! \fn		   uint8_t *CFloodSquareClient::Buffer(uint32_t uDataSize)
+ *
+ *  \brief     Return the shared buffer where the payload must be written. It holds uDataSize bytes
+ *             plus the growth of the square, so the encrypted result fits in place.
+ *             The previous buffer is kept (with its content) when it is large enough.
+ *
+ *  \param	   uDataSize - The size of the payload.
+ *  \exception none
+ *  \return    The buffer or 0 if the shared memory can't be created.
+ */
+uint8_t *CFloodSquareClient::Buffer(uint32_t uDataSize)
+{
+	// The square holds the payload and its size, the edge is rounded up by less than 4 pixels :
+	// (sqrt(bits) + 4)^2 / 8 < bytes + sqrt(bits) + 2
+	uint64_t ullBits = ((uint64_t)uDataSize + sizeof(uint32_t)) << 3 ;
+	uint64_t ullSize = uDataSize + sizeof(uint32_t) + (uint64_t)sqrt((double)ullBits) + 3 ;
+
+	// Round up to the page size
+	uint64_t ullPage = (uint64_t)sysconf(_SC_PAGESIZE) ;
+	ullSize = ((ullSize + ullPage - 1) / ullPage) * ullPage ;
+
+	if(ullSize > 0xFFFFFFFF)
+		return 0 ;
+
+	if(_pucBuffer && ullSize <= _ulBufferSize)
+		return _pucBuffer ;
+
+	ReleaseBuffer() ;
+
+	_nBuffer = memfd_create("floodsquare", MFD_CLOEXEC | MFD_ALLOW_SEALING) ;
+
+	if(_nBuffer < 0)
+		return 0 ;
+
+	// The daemon refuses a memfd whose size isn't sealed, a shrink would fault its mapping
+	if(ftruncate(_nBuffer, (off_t)ullSize) < 0 || fcntl(_nBuffer, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+		ReleaseBuffer() ;
+		return 0 ;
+	}
+
+	void *p = mmap(0, (size_t)ullSize, PROT_READ | PROT_WRITE, MAP_SHARED, _nBuffer, 0) ;
+
+	if(MAP_FAILED == p) {
+		ReleaseBuffer() ;
+		return 0 ;
+	}
+
+	_pucBuffer = (uint8_t *)p ;
+	_ulBufferSize = (uint32_t)ullSize ;
+	_bBufferSent = false ;
+
+	return _pucBuffer ;
+}
+
+/*! \fn		   void CFloodSquareClient::ReleaseBuffer(void)
+ *
+ *  \brief     Unmap and close the shared buffer.
+ *
+ *  \exception none
+ *  \return    none
+ */
+void CFloodSquareClient::ReleaseBuffer(void)
+{
+	if(_pucBuffer)
+		munmap(_pucBuffer, _ulBufferSize) ;
+
+	if(_nBuffer >= 0)
+		close(_nBuffer) ;
+
+	_pucBuffer = 0 ;
+	_nBuffer = -1 ;
+	_ulBufferSize = 0 ;
+	_bBufferSent = false ;
+}
+
+/*! \fn		   bool CFloodSquareClient::Encrypt(uint32_t uSize, const std::string &sKey, uint32_t *uEncryptedSize, CFloodSquare::ESalt eSalt, CFloodSquare::ECompress eCompress)
+ *
+ *  \brief     Encrypt the uSize first bytes of the shared buffer, the result replaces them.
+ *
+ *  \exception none
+ *  \return    true if success, otherwise _eLastStatus gives the reason.
+ */
+bool CFloodSquareClient::Encrypt(uint32_t uSize, const std::string &sKey, uint32_t *uEncryptedSize, CFloodSquare::ESalt eSalt, CFloodSquare::ECompress eCompress)
+{
+	return Submit(evEncrypt, uSize, sKey, uEncryptedSize, eSalt, eCompress) ;
+}
+
+/*! \fn		   bool CFloodSquareClient::Decrypt(uint32_t uSize, const std::string &sKey, uint32_t *uDecryptedSize, CFloodSquare::ESalt eSalt)
+ *
+ *  \brief     Decrypt the uSize first bytes of the shared buffer, the result replaces them.
+ *
+ *  \exception none
+ *  \return    true if success, otherwise _eLastStatus gives the reason.
+ */
+bool CFloodSquareClient::Decrypt(uint32_t uSize, const std::string &sKey, uint32_t *uDecryptedSize, CFloodSquare::ESalt eSalt)
+{
+	return Submit(evDecrypt, uSize, sKey, uDecryptedSize, eSalt, CFloodSquare::evCompressNone) ;
+}
+
+/*! \fn		   bool CFloodSquareClient::Submit(EOperation eOperation, uint32_t uSize, const std::string &sKey, uint32_t *uResultSize, CFloodSquare::ESalt eSalt, CFloodSquare::ECompress eCompress)
+ *
+ *  \brief     Send a job to the daemon and wait for the reply. The memfd is attached to the
+ *             message only the first time it is used on this connection.
+ *
+ *  \exception none
+ *  \return    true if success, otherwise _eLastStatus gives the reason.
+ */
+bool CFloodSquareClient::Submit(EOperation eOperation, uint32_t uSize, const std::string &sKey, uint32_t *uResultSize, CFloodSquare::ESalt eSalt, CFloodSquare::ECompress eCompress)
+{
+	SFloodSquareRequest request ;
+	SFloodSquareReply reply ;
+
+	_eLastStatus = evBadRequest ;
+
+	if(_nSocket < 0 || 0 == _pucBuffer || uSize > _ulBufferSize || sKey.length() > FLOODSQUARED_MAX_KEY)
+		return false ;
+
+	memset(&request, 0, sizeof(request)) ;
+	request.ulMagic = FLOODSQUARED_MAGIC ;
+	request.ulOperation = eOperation ;
+	request.ulSalt = eSalt ;
+	request.ulCompress = eCompress ;
+	request.ulNewBuffer = _bBufferSent ? 0 : 1 ;
+	request.ulBufferSize = _ulBufferSize ;
+	request.ulDataSize = uSize ;
+	request.ulKeyLength = (uint32_t)sKey.length() ;
+	memcpy(request.szKey, sKey.data(), sKey.length()) ;
+
+	struct iovec iov = { &request, sizeof(request) } ;
+	struct msghdr msg ;
+	char acControl[CMSG_SPACE(sizeof(int))] ;
+
+	memset(&msg, 0, sizeof(msg)) ;
+	msg.msg_iov = &iov ;
+	msg.msg_iovlen = 1 ;
+
+	if(!_bBufferSent) {
+
+		memset(acControl, 0, sizeof(acControl)) ;
+		msg.msg_control = acControl ;
+		msg.msg_controllen = sizeof(acControl) ;
+
+		struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg) ;
+		pcmsg->cmsg_level = SOL_SOCKET ;
+		pcmsg->cmsg_type = SCM_RIGHTS ;
+		pcmsg->cmsg_len = CMSG_LEN(sizeof(int)) ;
+		memcpy(CMSG_DATA(pcmsg), &_nBuffer, sizeof(int)) ;
+	}
+
+	_eLastStatus = evFailure ;
+
+	if(sendmsg(_nSocket, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(request))
+		return false ;
+
+	_bBufferSent = true ;
+
+	if(recv(_nSocket, &reply, sizeof(reply), 0) != (ssize_t)sizeof(reply))
+		return false ;
+
+	_eLastStatus = (EStatus)reply.ulStatus ;
+
+	if(evSuccess != _eLastStatus && evTooSmall != _eLastStatus)
+		return false ;
+
+	*uResultSize = reply.ulResultSize ;
+
+	if(evTooSmall == _eLastStatus)
+		return false ;
+
+	return true ;
+}
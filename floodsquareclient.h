@@ -0,0 +1,90 @@
+#if !defined(_FLOODSQUARECLIENT_H_INCLUDED_)
+#define _FLOODSQUARECLIENT_H_INCLUDED_
+
+#include <cstdint>
+#include <string>
+
+#include "floodsquare.h"
+
+// Default Unix domain socket of the floodsquared daemon
+#define FLOODSQUARED_SOCKET_PATH	"/tmp/floodsquared.sock"
+
+// Longest key accepted by the daemon, in hex characters
+#define FLOODSQUARED_MAX_KEY		256
+
+#define FLOODSQUARED_MAGIC			0x46535144	// 'FSQD'
+
+/*! \struct  SFloodSquareRequest
+ *
+ *  \brief   Job submitted to the daemon over a SOCK_SEQPACKET socket. The payload is not part
+ *           of the message : it lies at offset 0 of a memfd shared with the daemon, which is
+ *           passed once with SCM_RIGHTS (ulNewBuffer set) and kept mapped by the daemon for
+ *           the next jobs of the connection. The result is written back at offset 0.
+ *           The memfd must be sealed with F_SEAL_SHRINK | F_SEAL_GROW, otherwise the jobs
+ *           fail with evBadRequest.
+ */
+struct SFloodSquareRequest {
+	uint32_t ulMagic ;
+	uint32_t ulOperation ;		// CFloodSquareClient::EOperation
+	uint32_t ulSalt ;			// CFloodSquare::ESalt
+	uint32_t ulCompress ;		// CFloodSquare::ECompress
+	uint32_t ulNewBuffer ;		// 1 if a new memfd is attached to this message
+	uint32_t ulBufferSize ;		// size of the shared buffer, in bytes
+	uint32_t ulDataSize ;		// size of the payload, in bytes
+	uint32_t ulKeyLength ;
+	char szKey[FLOODSQUARED_MAX_KEY] ;
+} ;
+
+/*! \struct  SFloodSquareReply
+ *
+ *  \brief   Daemon answer, the result itself is in the shared buffer.
+ */
+struct SFloodSquareReply {
+	uint32_t ulStatus ;			// CFloodSquareClient::EStatus
+	uint32_t ulResultSize ;		// size of the result, in bytes (or needed size with evTooSmall)
+} ;
+
+/*! \class   CFloodSquareClient
+ *
+ *  \brief   Client of the floodsquared daemon (Linux only).
+ *
+ *           Buffer() returns the shared memory area where the caller writes the payload,
+ *           Encrypt() or Decrypt() then leaves the result in place in the same area.
+ *           The area is reused as long as it is large enough. A compressed payload may
+ *           decrypt to more than the area holds : the job then fails with evTooSmall and
+ *           *uDecryptedSize gives the size to request with Buffer() before a new attempt.
+ */
+class CFloodSquareClient
+{
+public:
+	CFloodSquareClient(void) ;
+	~CFloodSquareClient(void) ;
+
+	enum EOperation { evEncrypt, evDecrypt } ;
+	enum EStatus    { evSuccess, evBadRequest, evBadKey, evTooSmall, evFailure } ;
+
+	bool Connect(const std::string &sPath = FLOODSQUARED_SOCKET_PATH) ;
+	void Close(void) ;
+
+	uint8_t *Buffer(uint32_t uDataSize) ;
+
+	bool Encrypt(uint32_t uSize, const std::string &sKey, uint32_t *uEncryptedSize, CFloodSquare::ESalt eSalt = CFloodSquare::evSalt, CFloodSquare::ECompress eCompress = CFloodSquare::evCompressNone) ;
+	bool Decrypt(uint32_t uSize, const std::string &sKey, uint32_t *uDecryptedSize, CFloodSquare::ESalt eSalt = CFloodSquare::evSalt) ;
+
+	EStatus _eLastStatus ;
+
+private:
+
+	bool Submit(EOperation eOperation, uint32_t uSize, const std::string &sKey, uint32_t *uResultSize, CFloodSquare::ESalt eSalt, CFloodSquare::ECompress eCompress) ;
+
+	void ReleaseBuffer(void) ;
+
+	int _nSocket ;
+
+	int _nBuffer ;				// memfd
+	uint8_t *_pucBuffer ;		// mapping of the memfd
+	uint32_t _ulBufferSize ;	// in bytes
+	bool _bBufferSent ;			// the daemon already holds the memfd
+} ;
+
+#endif // _FLOODSQUARECLIENT_H_INCLUDED_
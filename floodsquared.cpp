@@ -0,0 +1,447 @@
+/*
+
+  FloodSquare Cipher - floodsquared.cpp
+  Version 0.0.1
+
+  Local encryption daemon (Linux only). Worker threads stay warm with their own CFloodSquare
+  (whose arrays are reused from one job to the next) and take the jobs of every client
+  connection from a shared epoll set, so connected but idle clients hold no worker.
+  Payloads are never copied through the socket : clients pass a memfd once per connection,
+  the daemon keeps it mapped and writes the results in place. See floodsquareclient.h.
+
+    Simply compile :
+      g++ -O2 -pthread floodsquared.cpp floodsquare.cpp -o floodsquared
+
+    Usage :
+      floodsquared [-s socket_path] [-t threads]
+
+*/
+
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std ;
+
+#include "floodsquare.h"
+#include "floodsquareclient.h"
+
+// Pause before accepting again when the process is out of file descriptors, in milliseconds
+#define FLOODSQUARED_ACCEPT_BACKOFF	100
+
+static const char *g_pszSocketPath = FLOODSQUARED_SOCKET_PATH ;
+
+/*! \fn		   static bool IsSquareSize(uint32_t ulSize)
+ *
+ *  \brief     Check that ulSize bytes form a FloodSquare block (edge multiple of 4), so
+ *             CFloodSquare::Decrypt() doesn't read beyond the payload.
+ *
+ *  \exception none
+ *  \return    true if the size is the size of a square
+ */
+static bool IsSquareSize(uint32_t ulSize)
+{
+	uint64_t ullBits = (uint64_t)ulSize << 3 ;
+	uint64_t ullEdge = (uint64_t)sqrt((double)ullBits) ;
+
+	while(ullEdge * ullEdge > ullBits)
+		ullEdge-- ;
+
+	while((ullEdge + 1) * (ullEdge + 1) <= ullBits)
+		ullEdge++ ;
+
+	return ulSize > 0 && ullEdge * ullEdge == ullBits && (ullEdge % 4) == 0 ;
+}
+
+/*! \fn		   static uint32_t Process(CFloodSquare &floodsquare, const SFloodSquareRequest &request, uint8_t *pucBuffer, uint32_t ulBufferSize, uint32_t *pulResultSize)
+ *
+ *  \brief     Run one job on the shared buffer and write the result in place.
+ *
+ *  \exception none
+ *  \return    A CFloodSquareClient::EStatus value
+ */
+static uint32_t Process(CFloodSquare &floodsquare, const SFloodSquareRequest &request, uint8_t *pucBuffer, uint32_t ulBufferSize, uint32_t *pulResultSize)
+{
+	uint8_t *pucResult ;
+	uint32_t ulResultSize ;
+
+	if(FLOODSQUARED_MAGIC != request.ulMagic || 0 == pucBuffer || request.ulDataSize > ulBufferSize || request.ulKeyLength > FLOODSQUARED_MAX_KEY)
+		return CFloodSquareClient::evBadRequest ;
+
+	if(CFloodSquare::evSaltNone != request.ulSalt && CFloodSquare::evSalt != request.ulSalt)
+		return CFloodSquareClient::evBadRequest ;
+
+	if(CFloodSquare::evCompressNone != request.ulCompress && CFloodSquare::evCompressLZ != request.ulCompress)
+		return CFloodSquareClient::evBadRequest ;
+
+	std::string sKey(request.szKey, request.ulKeyLength) ;
+	CFloodSquare::ESalt eSalt = (CFloodSquare::ESalt)request.ulSalt ;
+	CFloodSquare::ECompress eCompress = (CFloodSquare::ECompress)request.ulCompress ;
+
+	try {
+		if(CFloodSquareClient::evEncrypt == request.ulOperation) {
+
+			floodsquare.Encrypt(pucBuffer, request.ulDataSize, sKey, &pucResult, &ulResultSize, eSalt, false, eCompress) ;
+		}
+		else if(CFloodSquareClient::evDecrypt == request.ulOperation) {
+
+			if(!IsSquareSize(request.ulDataSize))
+				return CFloodSquareClient::evBadRequest ;
+
+			// A wrong key gives a meaningless size or compressed payload
+			if(!floodsquare.Decrypt(pucBuffer, request.ulDataSize, sKey, &pucResult, &ulResultSize, eSalt))
+				return CFloodSquareClient::evFailure ;
+		}
+		else {
+			return CFloodSquareClient::evBadRequest ;
+		}
+	}
+	catch (const bad_alloc &) {
+		return CFloodSquareClient::evFailure ;
+	}
+	catch (const exception &) {
+		return CFloodSquareClient::evBadKey ;
+	}
+
+	*pulResultSize = ulResultSize ;
+
+	if(ulResultSize > ulBufferSize)
+		return CFloodSquareClient::evTooSmall ;
+
+	memmove(pucBuffer, pucResult, ulResultSize) ;
+
+	return CFloodSquareClient::evSuccess ;
+}
+
+/*! \struct  SConnection
+ *
+ *  \brief   A client connection and the shared buffer it passed, kept mapped between jobs.
+ */
+struct SConnection {
+	int nSocket ;
+	uint8_t *pucBuffer ;
+	uint32_t ulBufferSize ;
+} ;
+
+/*! \fn		   static void MapBuffer(SConnection *pConnection, int nBuffer)
+ *
+ *  \brief     Replace the shared buffer of the connection by the memfd nBuffer, which is closed.
+ *             The buffer stays unmapped (the jobs then fail) if the memfd is not usable.
+ *
+ *  \exception none
+ *  \return    none
+ */
+static void MapBuffer(SConnection *pConnection, int nBuffer)
+{
+	struct stat st ;
+
+	if(pConnection->pucBuffer)
+		munmap(pConnection->pucBuffer, pConnection->ulBufferSize) ;
+
+	pConnection->pucBuffer = 0 ;
+	pConnection->ulBufferSize = 0 ;
+
+	// Trust the memfd size, not the request, to never touch pages beyond the end of the file.
+	// The size must be sealed : a client truncating the file would fault the mapping and kill the daemon.
+	int nSeals = fcntl(nBuffer, F_GET_SEALS) ;
+
+	if(nSeals >= 0 && (F_SEAL_SHRINK | F_SEAL_GROW) == (nSeals & (F_SEAL_SHRINK | F_SEAL_GROW)) &&
+		0 == fstat(nBuffer, &st) && st.st_size > 0 && st.st_size <= 0xFFFFFFFF) {
+
+		void *p = mmap(0, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, nBuffer, 0) ;
+
+		if(MAP_FAILED != p) {
+			pConnection->pucBuffer = (uint8_t *)p ;
+			pConnection->ulBufferSize = (uint32_t)st.st_size ;
+		}
+	}
+
+	close(nBuffer) ;
+}
+
+/*! \fn		   static bool Serve(SConnection *pConnection, CFloodSquare &floodsquare)
+ *
+ *  \brief     Process the job waiting on a connection and send the reply.
+ *
+ *  \exception none
+ *  \return    false if the connection must be closed (disconnected, error or a client that
+ *             doesn't read its replies)
+ */
+static bool Serve(SConnection *pConnection, CFloodSquare &floodsquare)
+{
+	SFloodSquareRequest request ;
+	SFloodSquareReply reply = { CFloodSquareClient::evBadRequest, 0 } ;
+	char acControl[CMSG_SPACE(sizeof(int))] ;
+	struct iovec iov = { &request, sizeof(request) } ;
+	struct msghdr msg ;
+	int nBuffer = -1 ;
+	ssize_t nReceived ;
+
+	memset(&msg, 0, sizeof(msg)) ;
+	msg.msg_iov = &iov ;
+	msg.msg_iovlen = 1 ;
+	msg.msg_control = acControl ;
+	msg.msg_controllen = sizeof(acControl) ;
+
+	do {
+		nReceived = recvmsg(pConnection->nSocket, &msg, MSG_CMSG_CLOEXEC) ;
+	} while(nReceived < 0 && EINTR == errno) ;
+
+	// Spurious wake up, wait for the next job
+	if(nReceived < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+		return true ;
+
+	if(nReceived <= 0)
+		return false ;
+
+	// Every fd the kernel installed must be closed : a single SCM_RIGHTS header may carry several.
+	// Only one memfd is expected, anything else (or a truncated control message) rejects the job.
+	bool bValid = !(msg.msg_flags & MSG_CTRUNC) ;
+
+	for(struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg) ; pcmsg ; pcmsg = CMSG_NXTHDR(&msg, pcmsg)) {
+
+		if(SOL_SOCKET != pcmsg->cmsg_level || SCM_RIGHTS != pcmsg->cmsg_type)
+			continue ;
+
+		size_t nFds = (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int) ;
+
+		for(size_t n = 0 ; n < nFds ; n++) {
+
+			int nFd ;
+			memcpy(&nFd, CMSG_DATA(pcmsg) + n * sizeof(int), sizeof(int)) ;
+
+			if(nBuffer < 0) {
+				nBuffer = nFd ;
+			}
+			else {
+				close(nFd) ;
+				bValid = false ;
+			}
+		}
+	}
+
+	if(nBuffer >= 0 && !bValid) {
+		close(nBuffer) ;
+		nBuffer = -1 ;
+	}
+
+	if(nBuffer >= 0)
+		MapBuffer(pConnection, nBuffer) ;
+
+	if(bValid && sizeof(request) == nReceived && (request.ulNewBuffer == 0) == (nBuffer < 0))
+		reply.ulStatus = Process(floodsquare, request, pConnection->pucBuffer, pConnection->ulBufferSize, &reply.ulResultSize) ;
+
+	// The socket is non blocking : a client that lets its replies pile up is dropped, not waited for
+	return send(pConnection->nSocket, &reply, sizeof(reply), MSG_NOSIGNAL) == (ssize_t)sizeof(reply) ;
+}
+
+/*! \fn		   static void CloseConnection(int nEpoll, SConnection *pConnection)
+ *
+ *  \brief     Stop polling the connection, release its buffer and close it.
+ *
+ *  \exception none
+ *  \return    none
+ */
+static void CloseConnection(int nEpoll, SConnection *pConnection)
+{
+	epoll_ctl(nEpoll, EPOLL_CTL_DEL, pConnection->nSocket, 0) ;
+
+	if(pConnection->pucBuffer)
+		munmap(pConnection->pucBuffer, pConnection->ulBufferSize) ;
+
+	close(pConnection->nSocket) ;
+
+	delete pConnection ;
+}
+
+/*! \fn		   static bool Accept(int nEpoll, int nListen)
+ *
+ *  \brief     Accept the pending connections and add them to the poll set.
+ *
+ *  \exception none
+ *  \return    false if the process is out of file descriptors (or memory), the pending
+ *             connections then stay in the backlog
+ */
+static bool Accept(int nEpoll, int nListen)
+{
+	for(;;) {
+
+		int nConnection = accept4(nListen, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC) ;
+
+		if(nConnection < 0) {
+			if(EINTR == errno || ECONNABORTED == errno)
+				continue ;
+			return !(EMFILE == errno || ENFILE == errno || ENOBUFS == errno || ENOMEM == errno) ;
+		}
+
+		SConnection *pConnection = new (std::nothrow) SConnection ;
+		struct epoll_event ev ;
+
+		if(0 == pConnection) {
+			close(nConnection) ;
+			continue ;
+		}
+
+		pConnection->nSocket = nConnection ;
+		pConnection->pucBuffer = 0 ;
+		pConnection->ulBufferSize = 0 ;
+
+		ev.events = EPOLLIN | EPOLLONESHOT ;
+		ev.data.ptr = pConnection ;
+
+		if(epoll_ctl(nEpoll, EPOLL_CTL_ADD, nConnection, &ev) < 0) {
+			close(nConnection) ;
+			delete pConnection ;
+		}
+	}
+}
+
+/*! \fn		   static void Worker(int nEpoll, int nListen)
+ *
+ *  \brief     Worker thread, with a CFloodSquare kept for the whole life of the thread.
+ *
+ *             The workers are not bound to connections : they all wait on the same epoll set
+ *             and each one takes the next ready job, whatever the connection. A connection is
+ *             registered with EPOLLONESHOT, so only one worker at a time handles it, and it is
+ *             re-armed once its job has been answered. Idle connections cost no worker.
+ *
+ *  \exception none
+ *  \return    none
+ */
+static void Worker(int nEpoll, int nListen)
+{
+	CFloodSquare floodsquare ;
+
+	for(;;) {
+
+		struct epoll_event ev ;
+
+		int nEvents = epoll_wait(nEpoll, &ev, 1, -1) ;
+
+		if(nEvents < 0) {
+			if(EINTR == errno)
+				continue ;
+			break ;
+		}
+
+		if(0 == nEvents)
+			continue ;
+
+		// The listening socket is registered with a null pointer
+		if(0 == ev.data.ptr) {
+
+			// Out of descriptors the listener stays readable : re-arming it at once would spin,
+			// so this worker backs off while the others keep serving (and closing) connections
+			if(!Accept(nEpoll, nListen))
+				std::this_thread::sleep_for(std::chrono::milliseconds(FLOODSQUARED_ACCEPT_BACKOFF)) ;
+
+			ev.events = EPOLLIN | EPOLLONESHOT ;
+			epoll_ctl(nEpoll, EPOLL_CTL_MOD, nListen, &ev) ;
+			continue ;
+		}
+
+		SConnection *pConnection = (SConnection *)ev.data.ptr ;
+
+		if(!(ev.events & EPOLLIN) || !Serve(pConnection, floodsquare)) {
+			CloseConnection(nEpoll, pConnection) ;
+			continue ;
+		}
+
+		ev.events = EPOLLIN | EPOLLONESHOT ;
+
+		if(epoll_ctl(nEpoll, EPOLL_CTL_MOD, pConnection->nSocket, &ev) < 0)
+			CloseConnection(nEpoll, pConnection) ;
+	}
+}
+
+static void OnSignal(int)
+{
+	unlink(g_pszSocketPath) ;
+	_exit(0) ;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int nThreads = std::thread::hardware_concurrency() ;
+
+	for(int n = 1 ; n < argc ; n++) {
+		if(0 == strcmp(argv[n], "-s") && n + 1 < argc)
+			g_pszSocketPath = argv[++n] ;
+		else if(0 == strcmp(argv[n], "-t") && n + 1 < argc)
+			nThreads = (unsigned int)atoi(argv[++n]) ;
+		else {
+			cerr << "Usage: " << argv[0] << " [-s socket_path] [-t threads]" << endl ;
+			return 1 ;
+		}
+	}
+
+	if(0 == nThreads)
+		nThreads = 1 ;
+
+	struct sockaddr_un addr ;
+
+	if(strlen(g_pszSocketPath) >= sizeof(addr.sun_path)) {
+		cerr << "Socket path too long" << endl ;
+		return 1 ;
+	}
+
+	memset(&addr, 0, sizeof(addr)) ;
+	addr.sun_family = AF_UNIX ;
+	strcpy(addr.sun_path, g_pszSocketPath) ;
+
+	int nListen = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0) ;
+
+	unlink(g_pszSocketPath) ;
+
+	if(nListen < 0 || bind(nListen, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(nListen, SOMAXCONN) < 0) {
+		cerr << "Can't listen on " << g_pszSocketPath << ": " << strerror(errno) << endl ;
+		return 1 ;
+	}
+
+	signal(SIGINT, OnSignal) ;
+	signal(SIGTERM, OnSignal) ;
+	signal(SIGPIPE, SIG_IGN) ;
+
+	cerr << "floodsquared: " << nThreads << " workers on " << g_pszSocketPath << endl ;
+
+	int nEpoll = epoll_create1(EPOLL_CLOEXEC) ;
+	struct epoll_event ev ;
+
+	ev.events = EPOLLIN | EPOLLONESHOT ;
+	ev.data.ptr = 0 ;
+
+	if(nEpoll < 0 || epoll_ctl(nEpoll, EPOLL_CTL_ADD, nListen, &ev) < 0) {
+		cerr << "Can't poll " << g_pszSocketPath << ": " << strerror(errno) << endl ;
+		return 1 ;
+	}
+
+	std::vector<std::thread> vWorkers ;
+
+	for(unsigned int n = 0 ; n < nThreads ; n++)
+		vWorkers.emplace_back(Worker, nEpoll, nListen) ;
+
+	for(size_t n = 0 ; n < vWorkers.size() ; n++)
+		vWorkers[n].join() ;
+
+	close(nEpoll) ;
+	close(nListen) ;
+	unlink(g_pszSocketPath) ;
+
+	return 0 ;
+}
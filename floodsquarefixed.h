@@ -0,0 +1,428 @@
+#if !defined(_FLOODSQUAREFIXED_H_INCLUDED_)
+#define _FLOODSQUAREFIXED_H_INCLUDED_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "floodsquare.h"
+
+/*! \class   FloodSquareFixed
+ *
+ *  \brief   FloodSquare transform on a square whose edge is known at compile time.
+ *
+ *           Same algorithm and same output format as CFloodSquare, but the three bit
+ *           arrays and the exploration stack are std::array members : an instance can
+ *           live on the stack and never allocates. Sizes, indexing and transposition
+ *           are folded by the compiler. Intended for small messages, see the
+ *           FloodSquareFixedEncrypt() / FloodSquareFixedDecrypt() dispatchers below,
+ *           which pick the edge CFloodSquare::Create() would compute.
+ *
+ *           The output is a regular FloodSquare block and can be decrypted by
+ *           CFloodSquare::Decrypt(). When Edge is the edge CFloodSquare::Create() would
+ *           compute for the data size, the output is byte-identical.
+ *
+ *  \param   Edge - The square edge in bits (pixels), a multiple of 4.
+ */
+template <uint32_t Edge>
+class FloodSquareFixed
+{
+	static_assert(Edge > 0 && (Edge % 4) == 0, "The square edge must be a multiple of 4") ;
+	static_assert(Edge <= 0xFFFF, "The square edge must fit in 16 bits") ;
+
+public:
+	static constexpr uint32_t SquareEdge  = Edge ;							// in bits
+	static constexpr uint32_t BitCount    = Edge * Edge ;					// in bits
+	static constexpr uint32_t SquareSize  = BitCount >> 3 ;				// in bytes
+	static constexpr uint32_t MaxDataSize = SquareSize - sizeof(uint32_t) ;	// in bytes
+
+	static constexpr uint32_t GuardStride = Edge + 2 ;						// in bits, see CFloodSquare::MarkGuardBorder()
+	static constexpr uint32_t MemorySize  = ((GuardStride * GuardStride) + 7) >> 3 ;	// in bytes
+
+	/*! \fn		   bool Encrypt(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t **ppEncrypted, uint32_t *uEncryptedSize, CFloodSquare::ESalt eSalt)
+	 *
+	 *  \brief     Encrypt the data using the key passed in argument. Unlike CFloodSquare::Encrypt()
+	 *             the input data is left untouched, the salt is applied to the copy inside the square.
+	 *
+	 *  \exception none
+	 *  \return    true if success, false if the data doesn't fit in the square or if the key
+	 *             is not composed by hex characters '0123456789ABCDEF'. *ppEncrypted points
+	 *             inside this object and stays valid until the next call.
+	 */
+	bool Encrypt(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t **ppEncrypted, uint32_t *uEncryptedSize, CFloodSquare::ESalt eSalt = CFloodSquare::evSalt)
+	{
+		if(uSize > MaxDataSize || !IsHexKey(sKey))
+			return false ;
+
+		_aData.fill(0xff) ;
+
+		// Copy the size of the data at offset 0, followed by the data itself
+		memcpy(_aData.data(), &uSize, sizeof(uint32_t)) ;
+		memcpy(_aData.data() + sizeof(uint32_t), pData, uSize) ;
+
+		if(CFloodSquare::evSaltNone != eSalt)
+			Salt(_aData.data() + sizeof(uint32_t), uSize, eSalt) ;
+
+		for(size_t n = 0 ; n < sKey.length() ; n++) {
+
+			int nPos = HexValue(sKey[n]) ;
+
+			// Each hex digit is sliced into 2 values of 2 bits, see CFloodSquare::Encrypt()
+			CardinalTransform<CFloodSquare::evRegular>(nPos & 0x03) ;
+			CardinalTransform<CFloodSquare::evRegular>((nPos & 0x0C) >> 2) ;
+		}
+
+		*ppEncrypted = _aData.data() ;
+		*uEncryptedSize = SquareSize ;
+
+		return true ;
+	}
+
+	/*! \fn		   bool Decrypt(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t **ppDecrypted, uint32_t *uDecryptedSize, CFloodSquare::ESalt eSalt)
+	 *
+	 *  \brief     Decrypt the data using the key passed in argument.
+	 *
+	 *  \exception none
+	 *  \return    true if success, false if uSize is not the size of this square, if the key
+	 *             is not composed by hex characters or if the decrypted size is inconsistent.
+	 *             *ppDecrypted points inside this object and stays valid until the next call.
+	 */
+	bool Decrypt(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t **ppDecrypted, uint32_t *uDecryptedSize, CFloodSquare::ESalt eSalt = CFloodSquare::evSalt)
+	{
+		if(uSize != SquareSize || !IsHexKey(sKey))
+			return false ;
+
+		memcpy(_aTransform.data(), pData, SquareSize) ;
+
+		// For decryption, we read the key string in reverse order
+		for(size_t n = sKey.length() ; n-- > 0 ; ) {
+
+			int nPos = HexValue(sKey[n]) ;
+
+			CardinalTransform<CFloodSquare::evInvert>((nPos & 0x0C) >> 2) ;
+			CardinalTransform<CFloodSquare::evInvert>(nPos & 0x03) ;
+		}
+
+		uint32_t ulSize ;
+		memcpy(&ulSize, _aData.data(), sizeof(uint32_t)) ;
+
+		if(ulSize > MaxDataSize)
+			return false ;
+
+		*uDecryptedSize = ulSize ;
+		*ppDecrypted = _aData.data() + sizeof(uint32_t) ;
+
+		if(CFloodSquare::evSaltNone != eSalt)
+			Salt(*ppDecrypted, ulSize, eSalt) ;
+
+		return true ;
+	}
+
+private:
+
+	// Smallest integer holding a bit number of the guarded memory array
+	typedef typename std::conditional < (GuardStride * GuardStride <= 0x10000), uint16_t, uint32_t >::type TBit ;
+
+	struct  SPoint {
+		TBit ulMemoryBit ;	// bit number in the guarded memory array
+		TBit ulDataBit ;	// bit number in the data array
+	} ;
+
+	std::array < uint8_t, SquareSize > _aData ;
+	std::array < uint8_t, SquareSize > _aTransform ;
+	std::array < uint8_t, MemorySize > _aMemory ;
+
+	// Each pixel is pushed at most once per transform, so the stack can't hold more than BitCount points.
+	std::array < SPoint, BitCount > _aStack ;
+
+	static constexpr int HexValue(char c) {
+		return (c >= '0' && c <= '9') ? c - '0' :
+			   (c >= 'A' && c <= 'F') ? c - 'A' + 10 :
+			   (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1 ;
+	}
+
+	static bool IsHexKey(const std::string &sKey) {
+		for(size_t n = 0 ; n < sKey.length() ; n++) {
+			if(HexValue(sKey[n]) < 0)
+				return false ;
+		}
+		return true ;
+	}
+
+	static void SetBit(uint8_t *puc, uint32_t bitnum) {
+		puc[bitnum >> 3] |= (0x80 >> (bitnum & 7)) ;
+	}
+
+	static bool IsSet(const uint8_t *puc, uint32_t bitnum) {
+		return (puc[bitnum >> 3] & (0x80 >> (bitnum & 7))) != 0 ;
+	}
+
+	static void Salt(uint8_t *pData, uint32_t uSize, CFloodSquare::ESalt eSalt) {
+		for(uint32_t n = 0 ; n < uSize ; n++)
+			pData[n] ^= (n % 2 == 0) ? (eSalt & 0x00ff) : (eSalt >> 8) ;
+	}
+
+	// Same mapping as CFloodSquare::CardinalTransform() : 0 for North, 1 for West, 2 for South, 3 for East.
+	template <CFloodSquare::ETransform eTransform>
+	void CardinalTransform(int nDirection) {
+		switch(nDirection)
+		{
+		case 0: Transform<CFloodSquare::evNorth, eTransform>() ; break ;
+		case 1: Transform<CFloodSquare::evWest,  eTransform>() ; break ;
+		case 2: Transform<CFloodSquare::evSouth, eTransform>() ; break ;
+		case 3: Transform<CFloodSquare::evEast,  eTransform>() ; break ;
+		}
+	}
+
+	// Same as CFloodSquare::TransposeCoordinates(), the direction being a compile time constant.
+	template <CFloodSquare::EDirection eDirection>
+	static void TransposeCoordinates(uint32_t &cx, uint32_t &cy) {
+		uint32_t c ;
+
+		switch(eDirection)
+		{
+		case CFloodSquare::evNorth:
+			break ;
+		case CFloodSquare::evEast:
+			c = cx ; cx = (Edge-1) - cy ; cy = c ;
+			break ;
+		case CFloodSquare::evWest:
+			c = cx ; cx = cy ; cy = (Edge-1) - c ;
+			break ;
+		case CFloodSquare::evSouth:
+			cx = (Edge-1) - cx ; cy = (Edge-1) - cy ;
+			break ;
+		}
+	}
+
+	// Linear offset of a step around the pixel, see CFloodSquare::Transform()
+	template <CFloodSquare::EDirection eDirection>
+	static constexpr uint32_t Offset(int ox, int oy, uint32_t ulStride) {
+		return (CFloodSquare::evNorth == eDirection) ? (uint32_t)ox + (uint32_t)oy * ulStride :
+			   (CFloodSquare::evEast  == eDirection) ? (uint32_t)ox * ulStride - (uint32_t)oy :
+			   (CFloodSquare::evWest  == eDirection) ? (uint32_t)oy - (uint32_t)ox * ulStride :
+			   0 - (uint32_t)ox - (uint32_t)oy * ulStride ;
+	}
+
+	// See CFloodSquare::MarkGuardBorder()
+	void MarkGuardBorder(void) {
+		for(uint32_t n = 0 ; n < GuardStride ; n++) {
+			SetBit(_aMemory.data(), n) ;
+			SetBit(_aMemory.data(), n + (GuardStride * (GuardStride - 1))) ;
+			SetBit(_aMemory.data(), GuardStride * n) ;
+			SetBit(_aMemory.data(), (GuardStride - 1) + (GuardStride * n)) ;
+		}
+	}
+
+	// See CFloodSquare::GetPixel()
+	template <CFloodSquare::ETransform eTransform>
+	CFloodSquare::EPixel GetPixel(uint32_t ulMemoryBit, uint32_t ulDataBit, uint32_t &nTransformBitCount) {
+		if(IsSet(_aMemory.data(), ulMemoryBit))
+			return CFloodSquare::evWhite ;
+
+		SetBit(_aMemory.data(), ulMemoryBit) ;
+
+		bool bBlack ;
+
+		if(CFloodSquare::evRegular == eTransform) {
+			bBlack = IsSet(_aData.data(), ulDataBit) ;
+			if(bBlack)
+				SetBit(_aTransform.data(), nTransformBitCount) ;
+		}
+		else {
+			bBlack = IsSet(_aTransform.data(), nTransformBitCount) ;
+		}
+
+		nTransformBitCount++ ;
+
+		return bBlack ? CFloodSquare::evBlack : CFloodSquare::evWhite ;
+	}
+
+	// See CFloodSquare::Transform()
+	template <CFloodSquare::EDirection eDirection, CFloodSquare::ETransform eTransform>
+	void Transform(void) {
+		// Same exploration order as CFloodSquare::aLookAround : { -1, 0 }, { 0, -1 }, { +1, 0 }, { 0, +1 }
+		static constexpr uint32_t aDataOffset[4] = {
+			Offset<eDirection>(-1, 0, Edge), Offset<eDirection>(0, -1, Edge),
+			Offset<eDirection>(+1, 0, Edge), Offset<eDirection>(0, +1, Edge) } ;
+		static constexpr uint32_t aMemoryOffset[4] = {
+			Offset<eDirection>(-1, 0, GuardStride), Offset<eDirection>(0, -1, GuardStride),
+			Offset<eDirection>(+1, 0, GuardStride), Offset<eDirection>(0, +1, GuardStride) } ;
+
+		uint32_t nTransformBitCount = 0 ;
+		uint32_t nTop = 0 ;
+
+		if(CFloodSquare::evRegular == eTransform)
+			_aTransform.fill(0x00) ;
+		else
+			_aData.fill(0x00) ;
+
+		_aMemory.fill(0x00) ;
+		MarkGuardBorder() ;
+
+		for(uint32_t cx = 0 ; cx < Edge ; cx++) {
+
+			for(uint32_t cy = 0 ; cy < Edge ; cy++) {
+
+				uint32_t tx = cx ;
+				uint32_t ty = cy ;
+				TransposeCoordinates<eDirection>(tx, ty) ;
+
+				uint32_t ulMemoryBit = (tx + 1) + (GuardStride * (ty + 1)) ;
+				uint32_t ulDataBit = tx + (Edge * ty) ;
+
+				if(CFloodSquare::evBlack == GetPixel<eTransform>(ulMemoryBit, ulDataBit, nTransformBitCount))
+					_aStack[nTop++] = { (TBit)ulMemoryBit, (TBit)ulDataBit } ;
+
+				while(nTop) {
+
+					SPoint p = _aStack[--nTop] ;
+
+					// Change pixel color to white
+					SetBit(_aData.data(), p.ulDataBit) ;
+
+					// Explore around the pixel, neighbours outside the square fall on the guard border
+					for(int i = 0 ; i < 4 ; i++) {
+						ulMemoryBit = p.ulMemoryBit + aMemoryOffset[i] ;
+						ulDataBit = p.ulDataBit + aDataOffset[i] ;
+
+						if(CFloodSquare::evBlack == GetPixel<eTransform>(ulMemoryBit, ulDataBit, nTransformBitCount))
+							_aStack[nTop++] = { (TBit)ulMemoryBit, (TBit)ulDataBit } ;
+					}
+				}
+			}
+		}
+
+		if(CFloodSquare::evRegular == eTransform)
+			_aData = _aTransform ;
+		else
+			_aTransform = _aData ;
+	}
+} ;
+
+// Largest square edge of the FloodSquareFixed instantiations used by the dispatchers, it holds 4 KB.
+// Every multiple of 4 from FLOODSQUAREFIXED_MIN_EDGE up to it has its own instantiation.
+#define FLOODSQUAREFIXED_MIN_EDGE		8
+#define FLOODSQUAREFIXED_MAX_EDGE		184
+#define FLOODSQUAREFIXED_MAX_SQUARE_SIZE	((FLOODSQUAREFIXED_MAX_EDGE * FLOODSQUAREFIXED_MAX_EDGE) >> 3)
+
+template <uint32_t Edge>
+inline bool FloodSquareFixedEncryptEdge(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t *pEncrypted, uint32_t uCapacity, uint32_t *uEncryptedSize, CFloodSquare::ESalt eSalt)
+{
+	FloodSquareFixed<Edge> floodsquare ;
+	uint8_t *pSquare ;
+	uint32_t uSquareSize ;
+
+	if(uCapacity < FloodSquareFixed<Edge>::SquareSize || !floodsquare.Encrypt(pData, uSize, sKey, &pSquare, &uSquareSize, eSalt))
+		return false ;
+
+	memcpy(pEncrypted, pSquare, uSquareSize) ;
+	*uEncryptedSize = uSquareSize ;
+
+	return true ;
+}
+
+template <uint32_t Edge>
+inline bool FloodSquareFixedDecryptEdge(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t *pDecrypted, uint32_t uCapacity, uint32_t *uDecryptedSize, CFloodSquare::ESalt eSalt)
+{
+	FloodSquareFixed<Edge> floodsquare ;
+	uint8_t *pPlain ;
+	uint32_t uPlainSize ;
+
+	if(!floodsquare.Decrypt(pData, uSize, sKey, &pPlain, &uPlainSize, eSalt) || uCapacity < uPlainSize)
+		return false ;
+
+	memcpy(pDecrypted, pPlain, uPlainSize) ;
+	*uDecryptedSize = uPlainSize ;
+
+	return true ;
+}
+
+typedef bool (*FloodSquareFixedFunction)(const uint8_t *, uint32_t, const std::string &, uint8_t *, uint32_t, uint32_t *, CFloodSquare::ESalt) ;
+
+// Index n of the tables below holds the instantiation of edge FLOODSQUAREFIXED_MIN_EDGE + 4 * n
+#define FLOODSQUAREFIXED_EDGE_COUNT		(((FLOODSQUAREFIXED_MAX_EDGE - FLOODSQUAREFIXED_MIN_EDGE) >> 2) + 1)
+
+template <size_t... Index>
+inline const FloodSquareFixedFunction *FloodSquareFixedEncryptTable(std::index_sequence<Index...>)
+{
+	static const FloodSquareFixedFunction apfn[] = { &FloodSquareFixedEncryptEdge<FLOODSQUAREFIXED_MIN_EDGE + 4 * Index>... } ;
+	return apfn ;
+}
+
+template <size_t... Index>
+inline const FloodSquareFixedFunction *FloodSquareFixedDecryptTable(std::index_sequence<Index...>)
+{
+	static const FloodSquareFixedFunction apfn[] = { &FloodSquareFixedDecryptEdge<FLOODSQUAREFIXED_MIN_EDGE + 4 * Index>... } ;
+	return apfn ;
+}
+
+/*! \fn		   uint32_t FloodSquareFixedEdge(uint32_t uSquareDataSize)
+ *
+ *  \brief     The edge CFloodSquare::Create() computes for uSquareDataSize bytes (size field
+ *             included) : the smallest multiple of 4 whose square holds every bit.
+ *
+ *  \exception none
+ *  \return    The edge in bits, 0 if it is beyond FLOODSQUAREFIXED_MAX_EDGE
+ */
+inline uint32_t FloodSquareFixedEdge(uint32_t uSquareDataSize)
+{
+	if(uSquareDataSize > FLOODSQUAREFIXED_MAX_SQUARE_SIZE)
+		return 0 ;
+
+	uint32_t ulBitCount = uSquareDataSize << 3 ;
+	uint32_t ulEdge = FLOODSQUAREFIXED_MIN_EDGE ;
+
+	while(ulEdge * ulEdge < ulBitCount)
+		ulEdge += 4 ;
+
+	return ulEdge ;
+}
+
+/*! \fn		   bool FloodSquareFixedEncrypt(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t *pEncrypted, uint32_t uCapacity, uint32_t *uEncryptedSize, CFloodSquare::ESalt eSalt)
+ *
+ *  \brief     Encrypt with the FloodSquareFixed instantiation whose edge is the one CFloodSquare
+ *             would use, so the output is byte-identical to CFloodSquare::Encrypt() without
+ *             compression. pEncrypted must hold FLOODSQUAREFIXED_MAX_SQUARE_SIZE bytes, or at
+ *             least the size of the square.
+ *
+ *  \exception none
+ *  \return    true if success, false if the data is larger than the largest square, if the
+ *             output buffer is too small or if the key is invalid. The caller can then use CFloodSquare.
+ */
+inline bool FloodSquareFixedEncrypt(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t *pEncrypted, uint32_t uCapacity, uint32_t *uEncryptedSize, CFloodSquare::ESalt eSalt = CFloodSquare::evSalt)
+{
+	if(uSize > FloodSquareFixed<FLOODSQUAREFIXED_MAX_EDGE>::MaxDataSize)
+		return false ;
+
+	uint32_t ulEdge = FloodSquareFixedEdge(uSize + sizeof(uint32_t)) ;
+
+	return FloodSquareFixedEncryptTable(std::make_index_sequence<FLOODSQUAREFIXED_EDGE_COUNT>())[(ulEdge - FLOODSQUAREFIXED_MIN_EDGE) >> 2]
+		(pData, uSize, sKey, pEncrypted, uCapacity, uEncryptedSize, eSalt) ;
+}
+
+/*! \fn		   bool FloodSquareFixedDecrypt(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t *pDecrypted, uint32_t uCapacity, uint32_t *uDecryptedSize, CFloodSquare::ESalt eSalt)
+ *
+ *  \brief     Decrypt a block whose size is the size of a square of edge FLOODSQUAREFIXED_MIN_EDGE
+ *             to FLOODSQUAREFIXED_MAX_EDGE, e.g. any block from FloodSquareFixedEncrypt() or from
+ *             CFloodSquare::Encrypt() on up to 4 KB.
+ *
+ *  \exception none
+ *  \return    true if success, false if the block is not such a square, if the output buffer
+ *             is too small or if the key is invalid. The caller can then use CFloodSquare.
+ */
+inline bool FloodSquareFixedDecrypt(const uint8_t *pData, uint32_t uSize, const std::string &sKey, uint8_t *pDecrypted, uint32_t uCapacity, uint32_t *uDecryptedSize, CFloodSquare::ESalt eSalt = CFloodSquare::evSalt)
+{
+	uint32_t ulEdge = FloodSquareFixedEdge(uSize) ;
+
+	if(0 == ulEdge || ((ulEdge * ulEdge) >> 3) != uSize)
+		return false ;
+
+	return FloodSquareFixedDecryptTable(std::make_index_sequence<FLOODSQUAREFIXED_EDGE_COUNT>())[(ulEdge - FLOODSQUAREFIXED_MIN_EDGE) >> 2]
+		(pData, uSize, sKey, pDecrypted, uCapacity, uDecryptedSize, eSalt) ;
+}
+
+#endif // _FLOODSQUAREFIXED_H_INCLUDED_
@@ -0,0 +1,227 @@
+/*
+
+  FloodSquare Cipher - floodsquareload.cpp
+  Version 0.0.1
+
+  Load generator for the floodsquared daemon (Linux only) : each connection encrypts the
+  same payload in a loop, then the requests/sec and the latency percentiles are reported.
+  With -l the encryptions run in this process instead of the daemon, and the hardware
+  counters of the ingest, rounds and egress phases are reported (see floodsquareperf.h).
+
+    Simply compile :
+      g++ -O2 -pthread floodsquareload.cpp floodsquareclient.cpp floodsquare.cpp floodsquareperf.cpp -o floodsquareload
+
+    Usage :
+      floodsquareload [-s socket_path] [-c connections] [-n requests] [-b bytes] [-k key] [-l]
+
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std ;
+
+#include "floodsquareclient.h"
+#include "floodsquareperf.h"
+
+struct SLoadOptions {
+	std::string sPath ;
+	std::string sKey ;
+	uint32_t ulConnections ;
+	uint32_t ulRequests ;		// per connection
+	uint32_t ulBytes ;
+	bool bLocal ;				// run in process, with the performance counters
+} ;
+
+/*! \fn		   static bool Connection(const SLoadOptions &options, std::vector<double> &vLatency)
+ *
+ *  \brief     One client connection : submit options.ulRequests encryptions, one at a time, and
+ *             record the latency of each one in microseconds. The first result is decrypted
+ *             back to check the round trip.
+ *
+ *  \exception none
+ *  \return    true if every request succeeded
+ */
+static bool Connection(const SLoadOptions &options, std::vector<double> &vLatency)
+{
+	CFloodSquareClient client ;
+	std::vector<uint8_t> vPayload(options.ulBytes) ;
+	uint32_t ulSize ;
+
+	for(size_t n = 0 ; n < vPayload.size() ; n++)
+		vPayload[n] = (uint8_t)rand() ;
+
+	uint8_t *pucBuffer = client.Buffer(options.ulBytes) ;
+
+	if(0 == pucBuffer || !client.Connect(options.sPath))
+		return false ;
+
+	// Round trip check
+	memcpy(pucBuffer, vPayload.data(), options.ulBytes) ;
+
+	if(!client.Encrypt(options.ulBytes, options.sKey, &ulSize) || !client.Decrypt(ulSize, options.sKey, &ulSize))
+		return false ;
+
+	if(ulSize != options.ulBytes || 0 != memcmp(pucBuffer, vPayload.data(), ulSize))
+		return false ;
+
+	vLatency.reserve(options.ulRequests) ;
+
+	for(uint32_t n = 0 ; n < options.ulRequests ; n++) {
+
+		// The payload is rewritten because the result replaced it
+		memcpy(pucBuffer, vPayload.data(), options.ulBytes) ;
+
+		auto tStart = std::chrono::steady_clock::now() ;
+
+		if(!client.Encrypt(options.ulBytes, options.sKey, &ulSize))
+			return false ;
+
+		auto tEnd = std::chrono::steady_clock::now() ;
+
+		vLatency.push_back(std::chrono::duration<double, std::micro>(tEnd - tStart).count()) ;
+	}
+
+	return true ;
+}
+
+/*! \fn		   static bool LocalConnection(const SLoadOptions &options, std::vector<double> &vLatency, CFloodSquarePerf &perf, uint64_t *pullPixels)
+ *
+ *  \brief     Same as Connection() without the daemon : the encryptions run in this thread, the
+ *             counters are opened here because they only count the calling thread.
+ *
+ *  \exception none
+ *  \return    true if every request succeeded
+ */
+static bool LocalConnection(const SLoadOptions &options, std::vector<double> &vLatency, CFloodSquarePerf &perf, uint64_t *pullPixels)
+{
+	CFloodSquare floodsquare ;
+	std::vector<uint8_t> vPayload(options.ulBytes) ;
+	std::vector<uint8_t> vBuffer(options.ulBytes) ;
+	uint8_t *pucResult ;
+	uint32_t ulSize ;
+
+	for(size_t n = 0 ; n < vPayload.size() ; n++)
+		vPayload[n] = (uint8_t)rand() ;
+
+	perf.Open() ;
+	floodsquare._pObserver = &perf ;
+
+	vLatency.reserve(options.ulRequests) ;
+
+	try {
+		for(uint32_t n = 0 ; n < options.ulRequests ; n++) {
+
+			// Encrypt() salts its input in place
+			memcpy(vBuffer.data(), vPayload.data(), options.ulBytes) ;
+
+			auto tStart = std::chrono::steady_clock::now() ;
+
+			floodsquare.Encrypt(vBuffer.data(), options.ulBytes, options.sKey, &pucResult, &ulSize) ;
+
+			auto tEnd = std::chrono::steady_clock::now() ;
+
+			vLatency.push_back(std::chrono::duration<double, std::micro>(tEnd - tStart).count()) ;
+		}
+	}
+	catch (const exception &) {
+		return false ;
+	}
+
+	*pullPixels = (uint64_t)floodsquare._ulSquareEdge * floodsquare._ulSquareEdge ;
+
+	return true ;
+}
+
+static double Percentile(const std::vector<double> &vSorted, double dPercent)
+{
+	if(vSorted.empty())
+		return 0 ;
+
+	size_t n = (size_t)(dPercent / 100.0 * (double)(vSorted.size() - 1) + 0.5) ;
+
+	return vSorted[n] ;
+}
+
+int main(int argc, char *argv[])
+{
+	SLoadOptions options = { FLOODSQUARED_SOCKET_PATH, "e1f020c91178264867f3cb99f422cb3708db08a1736aa681558a5151ba2554bb", 4, 1000, 1024, false } ;
+
+	for(int n = 1 ; n < argc ; n++) {
+		if(0 == strcmp(argv[n], "-s") && n + 1 < argc)
+			options.sPath = argv[++n] ;
+		else if(0 == strcmp(argv[n], "-c") && n + 1 < argc)
+			options.ulConnections = (uint32_t)atoi(argv[++n]) ;
+		else if(0 == strcmp(argv[n], "-n") && n + 1 < argc)
+			options.ulRequests = (uint32_t)atoi(argv[++n]) ;
+		else if(0 == strcmp(argv[n], "-b") && n + 1 < argc)
+			options.ulBytes = (uint32_t)atoi(argv[++n]) ;
+		else if(0 == strcmp(argv[n], "-k") && n + 1 < argc)
+			options.sKey = argv[++n] ;
+		else if(0 == strcmp(argv[n], "-l"))
+			options.bLocal = true ;
+		else {
+			cerr << "Usage: " << argv[0] << " [-s socket_path] [-c connections] [-n requests] [-b bytes] [-k key] [-l]" << endl ;
+			return 1 ;
+		}
+	}
+
+	if(0 == options.ulConnections)
+		options.ulConnections = 1 ;
+
+	std::vector< std::vector<double> > vLatencies(options.ulConnections) ;
+	std::vector<char> vSuccess(options.ulConnections, 0) ;
+	std::vector<CFloodSquarePerf> vPerf(options.ulConnections) ;
+	std::vector<std::thread> vThreads ;
+	std::vector<uint64_t> vPixels(options.ulConnections, 0) ;
+
+	auto tStart = std::chrono::steady_clock::now() ;
+
+	for(uint32_t n = 0 ; n < options.ulConnections ; n++) {
+		if(options.bLocal)
+			vThreads.emplace_back([&, n]() { vSuccess[n] = LocalConnection(options, vLatencies[n], vPerf[n], &vPixels[n]) ; }) ;
+		else
+			vThreads.emplace_back([&, n]() { vSuccess[n] = Connection(options, vLatencies[n]) ; }) ;
+	}
+
+	for(size_t n = 0 ; n < vThreads.size() ; n++)
+		vThreads[n].join() ;
+
+	double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count() ;
+
+	std::vector<double> vAll ;
+
+	for(uint32_t n = 0 ; n < options.ulConnections ; n++) {
+		if(!vSuccess[n]) {
+			cerr << "Connection " << n << " failed" << endl ;
+			return 1 ;
+		}
+		vAll.insert(vAll.end(), vLatencies[n].begin(), vLatencies[n].end()) ;
+	}
+
+	std::sort(vAll.begin(), vAll.end()) ;
+
+	cout << fixed << setprecision(1) ;
+	cout << vAll.size() << " requests of " << options.ulBytes << " bytes on " << options.ulConnections << " connections in " << dSeconds << " s" << endl ;
+	cout << "requests/sec : " << (double)vAll.size() / dSeconds << endl ;
+	cout << "latency (us) : p50 " << Percentile(vAll, 50) << "  p90 " << Percentile(vAll, 90) << "  p99 " << Percentile(vAll, 99)
+		<< "  p99.9 " << Percentile(vAll, 99.9) << "  max " << (vAll.empty() ? 0 : vAll.back()) << endl ;
+
+	if(options.bLocal) {
+
+		// Same payload size on every connection, so the same square
+		for(uint32_t n = 1 ; n < options.ulConnections ; n++)
+			vPerf[0].Add(vPerf[n]) ;
+
+		cout << endl ;
+		vPerf[0].Report(cout, vPixels[0]) ;
+	}
+
+	return 0 ;
+}
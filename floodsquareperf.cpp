@@ -0,0 +1,308 @@
+/*
+
+  FloodSquare Cipher - floodsquareperf.cpp
+  Version 0.0.1
+
+  Hardware performance counters (perf_event_open on Linux), timing only elsewhere.
+
+    Simply compile :
+      g++ -c floodsquareperf.cpp
+
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std ;
+
+#include "floodsquareperf.h"
+
+static const char *g_apszCounterName[CFloodSquarePerf::evCounterCount] = {
+	"cycles", "instructions", "cache-misses", "branch-misses", "dTLB-misses"
+} ;
+
+static const char *g_apszPhaseName[CFloodSquarePerf::evPhaseCount] = {
+	"ingest", "rounds", "egress"
+} ;
+
+/*! \fn		   CFloodSquarePerf::CFloodSquarePerf(void)
+ *
+ *  \brief	   Constructor, no counter opened.
+ *
+ *  \exception none
+ *  \return    none
+ */
+CFloodSquarePerf::CFloodSquarePerf(void) :
+	_sUnavailable("not opened")
+{
+	for(int n = 0 ; n < evCounterCount ; n++) {
+		_anCounter[n] = -1 ;
+		_abAvailable[n] = false ;
+	}
+
+	Reset() ;
+}
+
+/*! \fn        CFloodSquarePerf::~CFloodSquarePerf(void)
+ *
+ *  \brief     Destructor, close the counters.
+ *
+ *  \exception none
+ *  \return    none
+ */
+CFloodSquarePerf::~CFloodSquarePerf(void)
+{
+	Close() ;
+}
+
+/*! \fn		   bool CFloodSquarePerf::Open(void)
+ *
+ *  \brief     Open the counters for the calling thread. Each counter is opened on its own,
+ *             so a missing event (e.g. no dTLB event in a virtual machine) doesn't hide the others.
+ *
+ *  \exception none
+ *  \return    true if at least one counter is available, otherwise only the time is measured
+ *             and _sUnavailable gives the reason.
+ */
+bool CFloodSquarePerf::Open(void)
+{
+	bool bAny = false ;
+
+	Close() ;
+
+#if defined(__linux__)
+	static const uint32_t aulType[evCounterCount] = {
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+	} ;
+	static const uint64_t aullConfig[evCounterCount] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+	} ;
+
+	int nError = 0 ;
+
+	for(int n = 0 ; n < evCounterCount ; n++) {
+
+		struct perf_event_attr attr ;
+
+		memset(&attr, 0, sizeof(attr)) ;
+		attr.size = sizeof(attr) ;
+		attr.type = aulType[n] ;
+		attr.config = aullConfig[n] ;
+		attr.exclude_kernel = 1 ;	// allowed with perf_event_paranoid <= 2
+		attr.exclude_hv = 1 ;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING ;
+
+		_anCounter[n] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0) ;
+
+		if(_anCounter[n] < 0) {
+			nError = errno ;
+			continue ;
+		}
+
+		_abAvailable[n] = true ;
+		bAny = true ;
+	}
+
+	_sUnavailable = bAny ? "" : string("perf_event_open: ") + strerror(nError) ;
+#else
+	_sUnavailable = "no perf_event_open on this system" ;
+#endif
+
+	return bAny ;
+}
+
+/*! \fn		   void CFloodSquarePerf::Close(void)
+ *
+ *  \brief     Close the counters, the accumulated values are kept.
+ *
+ *  \exception none
+ *  \return    none
+ */
+void CFloodSquarePerf::Close(void)
+{
+	for(int n = 0 ; n < evCounterCount ; n++) {
+#if defined(__linux__)
+		if(_anCounter[n] >= 0)
+			close(_anCounter[n]) ;
+#endif
+		_anCounter[n] = -1 ;
+		_abAvailable[n] = false ;
+	}
+}
+
+/*! \fn		   void CFloodSquarePerf::Reset(void)
+ *
+ *  \brief     Clear the accumulated values of every phase.
+ *
+ *  \exception none
+ *  \return    none
+ */
+void CFloodSquarePerf::Reset(void)
+{
+	memset(_aPhase, 0, sizeof(_aPhase)) ;
+	memset(_aullStart, 0, sizeof(_aullStart)) ;
+}
+
+/*! \fn		   bool CFloodSquarePerf::Read(uint64_t aullCount[evCounterCount])
+ *
+ *  \brief     Read the current value of the counters. When the kernel multiplexes the counters,
+ *             the values are scaled by the ratio of the enabled and running times.
+ *
+ *  \exception none
+ *  \return    true if the available counters were read
+ */
+bool CFloodSquarePerf::Read(uint64_t aullCount[evCounterCount])
+{
+	bool bRead = true ;
+
+	for(int n = 0 ; n < evCounterCount ; n++) {
+
+		aullCount[n] = 0 ;
+
+#if defined(__linux__)
+		uint64_t aullValue[3] ;	// value, time enabled, time running
+
+		if(!_abAvailable[n])
+			continue ;
+
+		if(read(_anCounter[n], aullValue, sizeof(aullValue)) != (ssize_t)sizeof(aullValue)) {
+			bRead = false ;
+			continue ;
+		}
+
+		if(aullValue[2] && aullValue[2] < aullValue[1])
+			aullCount[n] = (uint64_t)((double)aullValue[0] * (double)aullValue[1] / (double)aullValue[2]) ;
+		else
+			aullCount[n] = aullValue[0] ;
+#endif
+	}
+
+	return bRead ;
+}
+
+/*! \fn		   void CFloodSquarePerf::Begin(EPhase ePhase)
+ *
+ *  \brief     Start measuring a phase.
+ *
+ *  \exception none
+ *  \return    none
+ */
+void CFloodSquarePerf::Begin(EPhase ePhase)
+{
+	Read(_aullStart[ePhase]) ;
+	_atStart[ePhase] = std::chrono::steady_clock::now() ;
+}
+
+/*! \fn		   void CFloodSquarePerf::End(EPhase ePhase)
+ *
+ *  \brief     Stop measuring a phase and add the deltas to its totals.
+ *
+ *  \exception none
+ *  \return    none
+ */
+void CFloodSquarePerf::End(EPhase ePhase)
+{
+	std::chrono::steady_clock::time_point tEnd = std::chrono::steady_clock::now() ;
+	uint64_t aullEnd[evCounterCount] ;
+
+	Read(aullEnd) ;
+
+	for(int n = 0 ; n < evCounterCount ; n++) {
+		if(aullEnd[n] > _aullStart[ePhase][n])
+			_aPhase[ePhase].aullCount[n] += aullEnd[n] - _aullStart[ePhase][n] ;
+	}
+
+	_aPhase[ePhase].dSeconds += std::chrono::duration<double>(tEnd - _atStart[ePhase]).count() ;
+	_aPhase[ePhase].ulCalls++ ;
+}
+
+/*! \fn		   void CFloodSquarePerf::Add(const CFloodSquarePerf &perf)
+ *
+ *  \brief     Add the totals of another object (e.g. another thread). A counter stays
+ *             available only if it is available in both.
+ *
+ *  \exception none
+ *  \return    none
+ */
+void CFloodSquarePerf::Add(const CFloodSquarePerf &perf)
+{
+	for(int p = 0 ; p < evPhaseCount ; p++) {
+		for(int n = 0 ; n < evCounterCount ; n++)
+			_aPhase[p].aullCount[n] += perf._aPhase[p].aullCount[n] ;
+
+		_aPhase[p].dSeconds += perf._aPhase[p].dSeconds ;
+		_aPhase[p].ulCalls += perf._aPhase[p].ulCalls ;
+	}
+
+	for(int n = 0 ; n < evCounterCount ; n++)
+		_abAvailable[n] = _abAvailable[n] && perf._abAvailable[n] ;
+}
+
+/*! \fn		   void CFloodSquarePerf::Report(std::ostream &os, uint64_t ullPixels) const
+ *
+ *  \brief     Write a table of the phases : calls, time and counters per pixel. A phase covers
+ *             the whole square once per call, so the values are divided by ullPixels * calls.
+ *             IPC is instructions / cycles. Unavailable counters are shown as "n/a", a phase
+ *             without any call (e.g. the egress of Encrypt()) as "not measured".
+ *
+ *  \param	   ullPixels - The number of pixels of the square
+ *  \exception none
+ *  \return    none
+ */
+void CFloodSquarePerf::Report(std::ostream &os, uint64_t ullPixels) const
+{
+	bool bAny = false ;
+
+	for(int n = 0 ; n < evCounterCount ; n++)
+		bAny = bAny || _abAvailable[n] ;
+
+	if(!bAny)
+		os << "hardware counters unavailable (" << _sUnavailable << "), timing only" << endl ;
+
+	os << left << setw(8) << "phase" << right << setw(7) << "calls" << setw(12) << "time (ms)" << setw(8) << "IPC" ;
+
+	for(int n = 0 ; n < evCounterCount ; n++)
+		os << setw(18) << (string(g_apszCounterName[n]) + "/px") ;
+
+	os << endl ;
+
+	for(int p = 0 ; p < evPhaseCount ; p++) {
+
+		const SPhase &phase = _aPhase[p] ;
+
+		if(0 == phase.ulCalls) {
+			os << left << setw(8) << g_apszPhaseName[p] << right << setw(7) << 0 << "   not measured" << endl ;
+			continue ;
+		}
+
+		double dUnits = (double)ullPixels * (double)phase.ulCalls ;
+
+		os << left << setw(8) << g_apszPhaseName[p] << right << setw(7) << phase.ulCalls
+			<< setw(12) << fixed << setprecision(3) << phase.dSeconds * 1000.0 ;
+
+		if(_abAvailable[evCycles] && _abAvailable[evInstructions] && phase.aullCount[evCycles])
+			os << setw(8) << setprecision(2) << (double)phase.aullCount[evInstructions] / (double)phase.aullCount[evCycles] ;
+		else
+			os << setw(8) << "n/a" ;
+
+		for(int n = 0 ; n < evCounterCount ; n++) {
+			if(_abAvailable[n] && ullPixels)
+				os << setw(18) << setprecision(4) << (double)phase.aullCount[n] / dUnits ;
+			else
+				os << setw(18) << "n/a" ;
+		}
+
+		os << endl ;
+	}
+}
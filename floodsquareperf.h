@@ -0,0 +1,64 @@
+#if !defined(_FLOODSQUAREPERF_H_INCLUDED_)
+#define _FLOODSQUAREPERF_H_INCLUDED_
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "floodsquare.h"
+
+/*! \class   CFloodSquarePerf
+ *
+ *  \brief   Hardware performance counters of the FloodSquare phases.
+ *
+ *           On Linux the counters are read with perf_event_open() for the calling thread
+ *           (user space only). When they can't be opened (no permission, container, other
+ *           systems) only the time of each phase is measured. Set CFloodSquare::_pObserver to
+ *           an opened object to capture the ingest, rounds (one per Transform()) and egress
+ *           phases. Encrypt() has no egress phase, it returns the square in place.
+ */
+class CFloodSquarePerf : public CFloodSquareObserver
+{
+public:
+	CFloodSquarePerf(void) ;
+	~CFloodSquarePerf(void) ;
+
+	// The object owns the counter descriptors, a copy would close them twice
+	CFloodSquarePerf(const CFloodSquarePerf &) = delete ;
+	CFloodSquarePerf &operator=(const CFloodSquarePerf &) = delete ;
+
+	enum ECounter { evCycles, evInstructions, evCacheMisses, evBranchMisses, evTLBMisses, evCounterCount } ;
+
+	bool Open(void) ;
+	void Close(void) ;
+	void Reset(void) ;
+
+	virtual void Begin(EPhase ePhase) ;
+	virtual void End(EPhase ePhase) ;
+
+	void Add(const CFloodSquarePerf &perf) ;
+	void Report(std::ostream &os, uint64_t ullPixels) const ;
+
+	struct SPhase {
+		uint64_t aullCount[evCounterCount] ;
+		double dSeconds ;
+		uint32_t ulCalls ;
+	} ;
+
+	SPhase _aPhase[evPhaseCount] ;
+
+	bool _abAvailable[evCounterCount] ;
+	std::string _sUnavailable ;		// reason why no counter is available
+
+private:
+
+	bool Read(uint64_t aullCount[evCounterCount]) ;
+
+	int _anCounter[evCounterCount] ;
+
+	uint64_t _aullStart[evPhaseCount][evCounterCount] ;
+	std::chrono::steady_clock::time_point _atStart[evPhaseCount] ;
+} ;
+
+#endif // _FLOODSQUAREPERF_H_INCLUDED_